@@ -1,6 +1,6 @@
 #!/bin/bash
 
-cd $HOME/rpmbuild/BUILD/gst-plugins-bad-0.10.*/
+cd $HOME/rpmbuild/BUILD/gst-plugins-bad-1.*/
 
 ./autogen.sh
 
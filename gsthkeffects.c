@@ -25,11 +25,14 @@
 #include <gst/base/gstbasetransform.h>
 #include "gsttrack.h"
 #include "gstmotrack.h"
+#include "hkmatch.h"
 
 
 static gboolean
 plugin_init (GstPlugin * plugin)
 {
+  matchInit ();
+  graphicsInit ();
 
   gst_element_register (plugin, "track", GST_RANK_NONE,
       gst_track_get_type ());
@@ -42,6 +45,6 @@ plugin_init (GstPlugin * plugin)
 
 GST_PLUGIN_DEFINE (GST_VERSION_MAJOR,
     GST_VERSION_MINOR,
-    "hkeffects",
+    hkeffects,
     "Video filters in gst-plugins-bad",
     plugin_init, VERSION, "LGPL", PACKAGE_NAME, GST_PACKAGE_ORIGIN)
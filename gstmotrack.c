@@ -41,11 +41,20 @@
  *   <para>
  *   #GstValue of #guint
  *   <classname>&quot;object&quot;</classname>:
- *   the temporary motracking number of each detected object.
- *   Note: Motracking numbers are initially assigned in top-down and
- *    left-to-right order. Motrack will attempt to assign the same
- *    motracking numbers to the same objects on each video frame,
- *    except if an object loses focus or leaves the frame.
+ *   the motracking number of each detected object.
+ *   Note: Motracking numbers are assigned in top-down and
+ *    left-to-right order as objects appear, and an object keeps its
+ *    number while it moves, even across another object's path. An
+ *    object that loses focus or leaves the frame keeps its number for
+ *    #GstMotrack:coast frames, then gives it up.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;team&quot;</classname>:
+ *   the index of the #GstMotrack:teams profile the object matched,
+ *   or 0 when no teams are set.
  *   </para>
  * </listitem>
  * <listitem>
@@ -63,12 +72,108 @@
  *   the x,y coordinates of the center of each detected object.
  *   </para>
  * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;area&quot;</classname>:
+ *   the number of pixels matching the object's colors.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;angle&quot;</classname>:
+ *   the direction of the object's long axis, in degrees 0-179
+ *   clockwise from horizontal.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValueArray of #guint
+ *   <classname>&quot;polygon&quot;</classname>:
+ *   x,y pairs of the vertices of the object's outline, clockwise,
+ *   only when the #GstMotrack:polygon property is set.
+ *   </para>
+ * </listitem>
+ * </itemizedlist>
+ *
+ * Each object also rides along on its video buffer as a
+ * #GstVideoRegionOfInterestMeta of type &quot;motrack&quot;, its id the
+ * object's number, its box the object's box. Its &quot;motrack&quot;
+ * parameter structure holds the team, area, angle, xc and yc fields
+ * above, so downstream elements need not listen on the bus.
+ *
+ * With #GstMotrack:mark set to nothing, motrack only reads the
+ * frame and runs in passthrough, so buffers shared with other
+ * branches, as after a tee, go on without being copied to be made
+ * writable. Such a buffer leaves with a new buffer header sharing
+ * the same memory, to carry the region of interest meta. Any other
+ * mark maps every frame for writing, whether or not anything is drawn
+ * on it, so a shared buffer is copied first.
+ *
+ * With many objects, one message per object can swamp an application's
+ * bus handler. When the #GstMotrack:batch property is set, motrack
+ * instead posts one message per frame, named
+ *
+ * <classname>&quot;motrack-frame&quot;</classname>
+ *
+ * with these fields:
+ * <itemizedlist>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #GstClockTime
+ *   <classname>&quot;timestamp&quot;</classname>:
+ *   the timestamp of the frame.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;count&quot;</classname>:
+ *   Total number of detected objects on screen.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;sequence&quot;</classname>:
+ *   the message's number, counting from 1. An application that
+ *   falls behind hands it back through #GstMotrack:acked once it is done
+ *   with the message, see #GstMotrack:pending.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;skipped&quot;</classname>:
+ *   frames since the previous message that were not posted because
+ *   #GstMotrack:pending messages were still unacknowledged. Each
+ *   message holds every object, so the newest one stands for them.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstBuffer
+ *   <classname>&quot;objects&quot;</classname>:
+ *   ten native endian 32 bit words per object: object, team, area,
+ *   angle, x1, y1, x2, y2, xc, yc, as in the per object message.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstBuffer
+ *   <classname>&quot;polygons&quot;</classname>:
+ *   only when the #GstMotrack:polygon property is set, each object's
+ *   outline in the same order, as 32 bit words: the number of
+ *   vertices, then their x,y pairs.
+ *   </para>
+ * </listitem>
  * </itemizedlist>
  *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
- * gst-launch -v v4l2src ! motrack ! autovideoconvert ! autovideosink
+ * gst-launch-1.0 -v v4l2src ! motrack ! autovideoconvert ! autovideosink
  * ]|
  * Insert motrack between video src and sink elements and set color 
  * properties. The motrackable objects' primary, or background color 
@@ -79,8 +184,16 @@
  * players with black and blue markings on the field. Set the 
  * object's (player's) background color to blue and the foreground 
  * colors to black, and orange. Want to motrack the other team, too? 
- * No problem! Multiple instances of motrack may be added to the 
- * pipeline.
+ * No problem! List every team's colors in the #GstMotrack:teams
+ * property, e.g. teams="0x0000ff,0x000000,0xff8000;0xff8000,0x000000,0x0000ff"
+ * and motrack labels each pixel once, tells the teams apart by their
+ * color1 and color2 markings, and reports each object's team.
+ *
+ * YUV, RGB and GRAY8 video are all tracked as they come. Colors are
+ * given in RGB either way and converted to the video's own space;
+ * Y-Y:U-U:V-V ranges stay YUV, and RGB pixels are converted to YUV
+ * to be tested against them. Gray video, from monochrome and
+ * infrared cameras, is matched on brightness alone.
  * </refsect2>
  */
 
@@ -94,6 +207,8 @@
 #include <math.h>
 #include "gstmotrack.h"
 #include "hkgraphics.h"
+#include "hkmatch.h"
+#include "hkblob.h"
 
 enum
 {
@@ -109,9 +224,35 @@ enum
   PROP_MCOLOR,
   PROP_THRESHOLD,
   PROP_MAX_OBJECTS,
+  PROP_COLORS,
+  PROP_TEAMS,
+  PROP_POLYGON,
+  PROP_THREADS,
+  PROP_PYRAMID,
+  PROP_CHROMA,
+  PROP_RESCAN,
+  PROP_INTERVAL,
+  PROP_MARGIN,
+  PROP_COAST,
+  PROP_BATCH,
+  PROP_PENDING,
+  PROP_ACKED,
 };
 
 #define DEFAULT_MESSAGE TRUE
+#define DEFAULT_POLYGON FALSE
+#define DEFAULT_THREADS 1
+#define DEFAULT_PYRAMID 0
+#define DEFAULT_CHROMA FALSE
+#define DEFAULT_RESCAN 1
+#define MOTION_GAIN 0.5f
+#define DEFAULT_INTERVAL 1
+#define DEFAULT_MARGIN 100
+#define DEFAULT_COAST 0
+#define DEFAULT_BATCH FALSE
+#define DEFAULT_PENDING 0
+#define BATCH_WORDS 10
+#define ADAPTIVE_INTERVAL 8
 #define DEFAULT_THRESHOLD 88
 #define DEFAULT_SPEED 20
 #define DEFAULT_MIN_SIZE 20
@@ -132,15 +273,40 @@ static void gst_motrack_finalize (GObject * object);
 
 static gboolean gst_motrack_start (GstBaseTransform * trans);
 static gboolean gst_motrack_stop (GstBaseTransform * trans);
+static GstFlowReturn gst_motrack_prepare_output_buffer (
+    GstBaseTransform * trans, GstBuffer * input, GstBuffer ** outbuf);
+static gboolean gst_motrack_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query);
+static gboolean gst_motrack_set_info (GstVideoFilter * filter,
+    GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps,
+    GstVideoInfo * out_info);
 
 static GstFlowReturn
-gst_motrack_prefilter (GstVideoFilter2 * videofilter2, GstBuffer * buf);
+gst_motrack_transform_frame_ip (GstVideoFilter * filter, GstVideoFrame * frame);
 
-static GstVideoFilter2Functions gst_motrack_filter_functions[];
+/* pad templates */
+
+#define VIDEO_CAPS GST_VIDEO_CAPS_MAKE \
+    ("{ I420, YV12, Y41B, Y42B, NV12, NV21, YUV9, YVU9, Y444, " \
+    "YUY2, UYVY, YVYU, AYUV, RGBx, BGRx, xRGB, xBGR, GRAY8 }")
+
+static GstStaticPadTemplate gst_motrack_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS)
+    );
+
+static GstStaticPadTemplate gst_motrack_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS)
+    );
 
 /* class initialization */
 
-#define DEBUG_INIT(bla) \
+#define DEBUG_INIT \
   GST_DEBUG_CATEGORY_INIT (gst_motrack_debug_category, "motrack", 0, \
       "debug category for motrack element");
 
@@ -158,6 +324,7 @@ static const GEnumValue repace_methods[] = {
   {GST_MOTRACK_MARK_METHOD_DECIMATE, "Obscure (decimate, blocks)",
       "decimate"},
   {GST_MOTRACK_MARK_METHOD_EDGE, "Edge detect", "edge"},
+  {GST_MOTRACK_MARK_METHOD_CANNY, "Thin edges (Canny)", "canny"},
   {GST_MOTRACK_MARK_METHOD_OUTLINE, "Color outlines", "outline"},
   {GST_MOTRACK_MARK_METHOD_COLORIZE, "Colorize to marker color",
       "colorize"},
@@ -175,35 +342,40 @@ gst_motrack_mark_method_get_type (void)
   return repace_method_type;
 }
 
-GST_BOILERPLATE_FULL (GstMotrack, gst_motrack, GstVideoFilter2,
-    GST_TYPE_VIDEO_FILTER2, DEBUG_INIT);
-
-static void
-gst_motrack_base_init (gpointer g_class)
-{
-  GstElementClass *element_class = GST_ELEMENT_CLASS (g_class);
-  gst_element_class_set_details_simple (element_class, "Object tracking / marking",
-      "Filter/Tracking",
-      "The motrack element tracks and optionally marks areas of color in a video stream.",
-    "Henry Kroll III, www.thenerdshow.com");
-}
+G_DEFINE_TYPE_WITH_CODE (GstMotrack, gst_motrack, GST_TYPE_VIDEO_FILTER,
+    DEBUG_INIT);
 
 static void
 gst_motrack_class_init (GstMotrackClass * klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
-  GstVideoFilter2Class *video_filter2_class = GST_VIDEO_FILTER2_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstVideoFilterClass *video_filter_class = GST_VIDEO_FILTER_CLASS (klass);
   GstBaseTransformClass *base_transform_class =
       GST_BASE_TRANSFORM_CLASS (klass);
 
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_motrack_sink_template);
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_motrack_src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Object tracking / marking",
+      "Filter/Tracking",
+      "The motrack element tracks and optionally marks areas of color in a video stream.",
+    "Henry Kroll III, www.thenerdshow.com");
+
   gobject_class->set_property = gst_motrack_set_property;
   gobject_class->get_property = gst_motrack_get_property;
   gobject_class->finalize = gst_motrack_finalize;
   base_transform_class->start = GST_DEBUG_FUNCPTR (gst_motrack_start);
   base_transform_class->stop = GST_DEBUG_FUNCPTR (gst_motrack_stop);
-
-  video_filter2_class->prefilter =
-      GST_DEBUG_FUNCPTR (gst_motrack_prefilter);
+  base_transform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_motrack_propose_allocation);
+  base_transform_class->prepare_output_buffer =
+      GST_DEBUG_FUNCPTR (gst_motrack_prepare_output_buffer);
+  video_filter_class->set_info = GST_DEBUG_FUNCPTR (gst_motrack_set_info);
+  video_filter_class->transform_frame_ip =
+      GST_DEBUG_FUNCPTR (gst_motrack_transform_frame_ip);
 
   g_object_class_install_property (gobject_class, PROP_MESSAGE,
       g_param_spec_boolean ("message", "message",
@@ -258,16 +430,100 @@ gst_motrack_class_init (GstMotrackClass * klass)
           "Marker color RGB white=0xffffff", 0, G_MAXUINT,
           GREEN,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COLORS,
+      g_param_spec_string ("colors", "Extra Colors",
+          "More colors to track: RGB, RGB/threshold or Y-Y:U-U:V-V ranges,"
+          " e.g. skin tones 0-255:77-127:133-173", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_TEAMS,
+      g_param_spec_string ("teams", "Teams",
+          "Team color profiles to track in one pass, replacing color0-2:"
+          " color0,color1,color2;color0,color1,color2...", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POLYGON,
+      g_param_spec_boolean ("polygon", "Polygon",
+          "Include each object's outline polygon in its message",
+          DEFAULT_POLYGON, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Horizontal bands to process each frame in parallel,"
+          " 0 = one per CPU", 0, 64, DEFAULT_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PYRAMID,
+      g_param_spec_uint ("pyramid", "Pyramid",
+          "Find objects in a copy of the frame halved this many times"
+          " first, then refine them at full size; 0 = full size only."
+          " Not used while rescan is above 1", 0, 2, DEFAULT_PYRAMID,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_CHROMA,
+      g_param_spec_boolean ("chroma", "Chroma",
+          "Match colors once per chroma sample of subsampled formats,"
+          " trading edge accuracy for speed",
+          DEFAULT_CHROMA, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_RESCAN,
+      g_param_spec_uint ("rescan", "Rescan",
+          "Search for new objects a strip at a time over this many frames,"
+          " matching only around known objects in between, at full size"
+          " whatever pyramid is; 1 = whole frame every frame", 1, 1000,
+          DEFAULT_RESCAN,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_INTERVAL,
+      g_param_spec_uint ("interval", "Interval",
+          "Analyze every nth frame and move the marks along with the"
+          " objects in between; 0 = as often as the fastest object needs",
+          0, 100, DEFAULT_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MARGIN,
+      g_param_spec_uint ("margin", "Margin",
+          "Between analyzed frames, widen each box by this percent of"
+          " how far its object is predicted to have moved", 0, 1000,
+          DEFAULT_MARGIN, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COAST,
+      g_param_spec_uint ("coast", "Coast",
+          "Frames an object may go unseen, moving as predicted, before"
+          " its tracking number is given up", 0, 1000,
+          DEFAULT_COAST, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_BATCH,
+      g_param_spec_boolean ("batch", "Batch",
+          "Post one message per frame carrying every object, packed in"
+          " a buffer, instead of one message per object",
+          DEFAULT_BATCH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PENDING,
+      g_param_spec_uint ("pending", "Pending",
+          "Skip a frame's batched message while this many posted ones"
+          " are not yet acked, 0 = never skip", 0, 1000,
+          DEFAULT_PENDING, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_ACKED,
+      g_param_spec_uint ("acked", "Acked",
+          "Sequence number of the last batched message the application"
+          " has handled", 0, G_MAXUINT,
+          0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
 
-  gst_video_filter2_class_add_functions (video_filter2_class,
-      gst_motrack_filter_functions);
+static void set_passthrough (GstMotrack *motrack)
+/* marks that change no pixels need only read the frame */
+{
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (motrack),
+      motrack->mark_method == GST_MOTRACK_MARK_METHOD_NOTHING);
 }
 
 static void
-gst_motrack_init (GstMotrack * motrack,
-    GstMotrackClass * motrack_class)
+gst_motrack_init (GstMotrack * motrack)
 {
   motrack->message = DEFAULT_MESSAGE;
+  motrack->polygon = DEFAULT_POLYGON;
+  motrack->threads = DEFAULT_THREADS;
+  motrack->pyramid = DEFAULT_PYRAMID;
+  motrack->chroma = DEFAULT_CHROMA;
+  motrack->rescan = DEFAULT_RESCAN;
+  motrack->interval = DEFAULT_INTERVAL;
+  motrack->margin = DEFAULT_MARGIN;
+  motrack->coast = DEFAULT_COAST;
+  motrack->batch = DEFAULT_BATCH;
+  motrack->pending = DEFAULT_PENDING;
+  motrack->sequence = motrack->acked = 0;
+  motrack->skipped = 0;
+  poolInit (&motrack->pool);
   motrack->color0 = DEFAULT_COLOR;
   motrack->color1 = DEFAULT_COLOR;
   motrack->color2 = DEFAULT_COLOR;
@@ -275,9 +531,9 @@ gst_motrack_init (GstMotrack * motrack,
   motrack->threshold = DEFAULT_THRESHOLD;
   motrack->max_objects = DEFAULT_MAX_OBJECTS;
   motrack->mark_method = DEFAULT_MARK_METHOD;
-  motrack->obj_count = 0;
-  for (int obj=MAX_OBJECTS; obj--;)
-    motrack->obj_found[obj][3] = 0;
+  set_passthrough (motrack);
+  motrack->table_dirty = motrack->mcolor_dirty = TRUE;
+  memset (&motrack->objects, 0, sizeof motrack->objects);
 }
 
 void
@@ -294,6 +550,7 @@ gst_motrack_set_property (GObject * object, guint property_id,
       break;
     case PROP_MARK_METHOD:
       motrack->mark_method = g_value_get_enum(value);
+      set_passthrough (motrack);
       break;
     case PROP_SPEED:
       motrack->speed = g_value_get_uint(value);
@@ -305,23 +562,81 @@ gst_motrack_set_property (GObject * object, guint property_id,
       motrack->maxsize = g_value_get_uint(value);
       break;
     case PROP_COLOR0:
+      GST_OBJECT_LOCK (motrack);
       motrack->color0 = g_value_get_uint(value);
-      rgb2yuv(motrack->color0, motrack->yuv0);
+      motrack->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (motrack);
       break;
     case PROP_COLOR1:
+      GST_OBJECT_LOCK (motrack);
       motrack->color1 = g_value_get_uint(value);
-      rgb2yuv(motrack->color1, motrack->yuv1);
+      motrack->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (motrack);
       break;
     case PROP_COLOR2:
+      GST_OBJECT_LOCK (motrack);
       motrack->color2 = g_value_get_uint(value);
-      rgb2yuv(motrack->color2, motrack->yuv2);
+      motrack->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (motrack);
       break;
     case PROP_MCOLOR:
+      GST_OBJECT_LOCK (motrack);
       motrack->mcolor = g_value_get_uint(value);
-      rgb2yuv(motrack->mcolor, motrack->mcyuv);
+      motrack->mcolor_dirty = TRUE;
+      GST_OBJECT_UNLOCK (motrack);
       break;
     case PROP_THRESHOLD:
+      GST_OBJECT_LOCK (motrack);
       motrack->threshold = g_value_get_uint(value);
+      motrack->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (motrack);
+      break;
+    case PROP_COLORS:
+      GST_OBJECT_LOCK (motrack);
+      g_free (motrack->colors);
+      motrack->colors = g_value_dup_string(value);
+      motrack->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (motrack);
+      break;
+    case PROP_TEAMS:
+      GST_OBJECT_LOCK (motrack);
+      g_free (motrack->teams);
+      motrack->teams = g_value_dup_string(value);
+      motrack->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (motrack);
+      break;
+    case PROP_POLYGON:
+      motrack->polygon = g_value_get_boolean(value);
+      break;
+    case PROP_THREADS:
+      motrack->threads = g_value_get_uint(value);
+      break;
+    case PROP_PYRAMID:
+      motrack->pyramid = g_value_get_uint(value);
+      break;
+    case PROP_CHROMA:
+      motrack->chroma = g_value_get_boolean(value);
+      break;
+    case PROP_RESCAN:
+      motrack->rescan = g_value_get_uint(value);
+      break;
+    case PROP_INTERVAL:
+      motrack->interval = g_value_get_uint(value);
+      break;
+    case PROP_MARGIN:
+      motrack->margin = g_value_get_uint(value);
+      break;
+    case PROP_COAST:
+      motrack->coast = g_value_get_uint(value);
+      break;
+    case PROP_BATCH:
+      motrack->batch = g_value_get_boolean(value);
+      break;
+    case PROP_PENDING:
+      motrack->pending = g_value_get_uint(value);
+      break;
+    case PROP_ACKED:
+      g_atomic_int_set (&motrack->acked, g_value_get_uint(value));
       break;
     case PROP_MAX_OBJECTS:
       motrack->max_objects = g_value_get_uint(value);
@@ -372,6 +687,49 @@ gst_motrack_get_property (GObject * object, guint property_id,
     case PROP_THRESHOLD:
       g_value_set_uint (value, motrack->threshold);
       break;
+    case PROP_COLORS:
+      GST_OBJECT_LOCK (motrack);
+      g_value_set_string (value, motrack->colors);
+      GST_OBJECT_UNLOCK (motrack);
+      break;
+    case PROP_TEAMS:
+      GST_OBJECT_LOCK (motrack);
+      g_value_set_string (value, motrack->teams);
+      GST_OBJECT_UNLOCK (motrack);
+      break;
+    case PROP_POLYGON:
+      g_value_set_boolean (value, motrack->polygon);
+      break;
+    case PROP_THREADS:
+      g_value_set_uint (value, motrack->threads);
+      break;
+    case PROP_PYRAMID:
+      g_value_set_uint (value, motrack->pyramid);
+      break;
+    case PROP_CHROMA:
+      g_value_set_boolean (value, motrack->chroma);
+      break;
+    case PROP_RESCAN:
+      g_value_set_uint (value, motrack->rescan);
+      break;
+    case PROP_INTERVAL:
+      g_value_set_uint (value, motrack->interval);
+      break;
+    case PROP_MARGIN:
+      g_value_set_uint (value, motrack->margin);
+      break;
+    case PROP_COAST:
+      g_value_set_uint (value, motrack->coast);
+      break;
+    case PROP_BATCH:
+      g_value_set_boolean (value, motrack->batch);
+      break;
+    case PROP_PENDING:
+      g_value_set_uint (value, motrack->pending);
+      break;
+    case PROP_ACKED:
+      g_value_set_uint (value, g_atomic_int_get (&motrack->acked));
+      break;
     case PROP_MAX_OBJECTS:
       g_value_set_uint (value, motrack->max_objects);
       break;
@@ -384,11 +742,25 @@ gst_motrack_get_property (GObject * object, guint property_id,
 void
 gst_motrack_finalize (GObject * object)
 {
+  GstMotrack *motrack;
+
   g_return_if_fail (GST_IS_MOTRACK (object));
+  motrack = GST_MOTRACK (object);
 
   /* clean up object here */
+  maskFree (&motrack->layout);
+  scratchFree (&motrack->layout);
+  plateFree (&motrack->layout);
+  tableFree (&motrack->table);
+  blobsFree (&motrack->blobs);
+  polygonFree (&motrack->poly);
+  poolFree (&motrack->pool);
+  pyramidFree (&motrack->coarse);
+  objectsFree (&motrack->objects);
+  g_free (motrack->colors);
+  g_free (motrack->teams);
 
-  G_OBJECT_CLASS (parent_class)->finalize (object);
+  G_OBJECT_CLASS (gst_motrack_parent_class)->finalize (object);
 }
 
 
@@ -404,170 +776,540 @@ gst_motrack_stop (GstBaseTransform * trans)
   return TRUE;
 }
 
+static gboolean
+gst_motrack_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+/* working in place, offer upstream the pools downstream picked, so */
+/* frames pass from one to the other uncopied, and accept video meta */
+/* for upstream's own plane layout */
+{
+  GstBufferPool *pool;
+  guint size, min, max;
+  if (decide_query){
+    for (guint i=0; i<gst_query_get_n_allocation_pools (decide_query); i++){
+      gst_query_parse_nth_allocation_pool (decide_query, i, &pool, &size,
+          &min, &max);
+      gst_query_add_allocation_pool (query, pool, size, min, max);
+      if (pool) gst_object_unref (pool);
+    }
+  }
+  if (!GST_BASE_TRANSFORM_CLASS (gst_motrack_parent_class)->propose_allocation
+      (trans, decide_query, query))
+    return FALSE;
+  gst_query_add_allocation_meta (query,
+      GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE, NULL);
+  return TRUE;
+}
+
 static GstFlowReturn
-gst_motrack_prefilter (GstVideoFilter2 * videofilter2, GstBuffer * buf)
+gst_motrack_prepare_output_buffer (GstBaseTransform * trans,
+    GstBuffer * input, GstBuffer ** outbuf)
+/* in passthrough, a buffer others still hold gets a header of its own */
+/* for the ROI meta; the copy shares the frame's memory, unwritten */
 {
-  return GST_FLOW_OK;
+  if (!gst_base_transform_is_passthrough (trans)
+      || gst_buffer_is_writable (input))
+    return GST_BASE_TRANSFORM_CLASS (gst_motrack_parent_class)->
+        prepare_output_buffer (trans, input, outbuf);
+  *outbuf = gst_buffer_copy (input);
+  return *outbuf ? GST_FLOW_OK : GST_FLOW_ERROR;
+}
+
+static void hkgraphics_layout (GstMotrack *motrack, hkVidLayout *vl,
+  GstVideoInfo *info)
+/* cache frame geometry in hkVidLayout struct for hkgraphics library */
+/* called upon each caps change; each frame brings its own strides */
+{
+  vl->space = GST_VIDEO_INFO_IS_RGB (info) ? SPACE_RGB
+    : GST_VIDEO_INFO_IS_GRAY (info) ? SPACE_GRAY : SPACE_YUV;
+  vl->width = GST_VIDEO_INFO_WIDTH (info),
+  vl->height = GST_VIDEO_INFO_HEIGHT (info),
+  vl->size = GST_VIDEO_INFO_SIZE (info);
+  for (int i=3;i--;){
+    vl->offset[i] = GST_VIDEO_INFO_COMP_OFFSET (info, i);
+    vl->stride[i] = GST_VIDEO_INFO_COMP_STRIDE (info, i);
+    vl->pstride[i] = GST_VIDEO_INFO_COMP_PSTRIDE (info, i);
+    vl->pheight[i] = GST_VIDEO_INFO_COMP_HEIGHT (info, i);
+    vl->pwidth[i] = GST_VIDEO_INFO_COMP_WIDTH (info, i);
+    vl->wshift[i] = GST_VIDEO_FORMAT_INFO_W_SUB (info->finfo, i);
+    vl->hshift[i] = GST_VIDEO_FORMAT_INFO_H_SUB (info->finfo, i);
+  }
+  layoutInit(vl);
+}
+
+static gboolean
+gst_motrack_set_info (GstVideoFilter * filter, GstCaps * incaps,
+    GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
+{
+  GstMotrack *motrack = GST_MOTRACK (filter);
+  hkgraphics_layout (motrack, &motrack->layout, in_info);
+  motrack->table_dirty = motrack->mcolor_dirty = TRUE;
+  maskInit (&motrack->layout);
+  scratchInit (&motrack->layout);
+  plateInit (&motrack->layout);
+  pyramidInit (&motrack->coarse, &motrack->layout, motrack->pyramid);
+  objectsInit (&motrack->objects, motrack->layout.width,
+    motrack->layout.height);
+  return TRUE;
 }
 
-static void hkgraphics_init (GstMotrack *motrack, hkVidLayout *vl, GstBuffer *buf)
-/* populate hkVidLayout struct for hkgraphics library */
+static void hkgraphics_init (GstMotrack *motrack, hkVidLayout *vl,
+  GstVideoFrame *frame)
+/* point cached hkVidLayout struct at this frame for hkgraphics library */
 /* called upon each video frame */
 {
-  GstVideoFormat format = GST_VIDEO_FILTER2_FORMAT (motrack);
-  guint8 *gdata = GST_BUFFER_DATA (buf);
-  vl->width = GST_VIDEO_FILTER2_WIDTH (motrack),
-  vl->height = GST_VIDEO_FILTER2_HEIGHT (motrack),
+  // rebuild color table only after colors, threshold or caps change,
+  // with the colors in the frame's own color space
+  if (motrack->table_dirty){
+    guint8 *yuv[3] = {motrack->yuv0, motrack->yuv1, motrack->yuv2};
+    guint space = motrack->layout.space;
+    GST_OBJECT_LOCK (motrack);
+    motrack->table_dirty = FALSE;
+    rgb2space(motrack->color0, space, motrack->yuv0);
+    rgb2space(motrack->color1, space, motrack->yuv1);
+    rgb2space(motrack->color2, space, motrack->yuv2);
+    tableSetup(&motrack->table, yuv, motrack->threshold, motrack->colors,
+      motrack->teams, space);
+    GST_OBJECT_UNLOCK (motrack);
+  }
+  // the mark color is only drawn, not looked up in the table
+  if (motrack->mcolor_dirty){
+    GST_OBJECT_LOCK (motrack);
+    motrack->mcolor_dirty = FALSE;
+    rgb2space(motrack->mcolor, motrack->layout.space, motrack->mcyuv);
+    GST_OBJECT_UNLOCK (motrack);
+  }
+  if (motrack->table.nteams) classesInit(&motrack->layout);
+  *vl = motrack->layout;
   vl->threshold = motrack->threshold,
+  vl->chroma = motrack->chroma,
   vl->color0 = motrack->yuv0,
   vl->color1 = motrack->yuv1;
   vl->color2 = motrack->yuv2;
+  // planes as mapped, with upstream's strides when it sent video meta
   for (int i=3;i--;){
-    vl->data[i] = gdata + gst_video_format_get_component_offset
-      (format, i, vl->width, vl->height);
-    vl->stride[i] = gst_video_format_get_row_stride
-      (format, i, vl->width);
-    vl->hscale[i] = vl->height /
-      gst_video_format_get_component_height (format, i, vl->height);
-    vl->wscale[i] = vl->width /
-      gst_video_format_get_component_width (format, i, vl->width);
+    vl->data[i] = GST_VIDEO_FRAME_COMP_DATA (frame, i);
+    vl->stride[i] = GST_VIDEO_FRAME_COMP_STRIDE (frame, i);
   }
+  vl->lut = motrack->table.lut;
+  vl->seed = motrack->table.seed;
+  if (!motrack->table.nteams) vl->classes = NULL;
+  // the whole frame; poolRun splits it into bands
+  vl->clip[0] = 0, vl->clip[1] = vl->height - 1;
+  poolThreads(&motrack->pool, motrack->threads);
 }
 
-static gboolean is_reject(GstMotrack *motrack, guint *rect, guint obj)
+static void rescan_strip(GstMotrack *motrack, hkVidLayout *vl)
+/* pick the rows searched for new objects this frame */
 {
-  gint sz = motrack->speed;
-  gboolean reject = FALSE;
-  // too small?
-  if (rect[2]-rect[0] < motrack->speed
-    || rect[3]-rect[1] < motrack->speed){
-    reject = TRUE;
+  guint h = vl->clip[1] - vl->clip[0] + 1, n = MIN(motrack->rescan, h),
+    k = motrack->frame % n;
+  motrack->strip[0] = vl->clip[0] + h * k / n;
+  motrack->strip[1] = vl->clip[0] + h * (k + 1) / n - 1;
+}
+
+static void predict(GstMotrack *motrack, hkVidLayout *vl, guint obj)
+/* where obj should be this frame if it keeps moving as it has: */
+/* its predicted box and center, and the box widened to a window */
+{
+  guint *found = motrack->objects.found[obj],
+    *pred = motrack->objects.pred[obj], *win = motrack->objects.win[obj];
+  gint d[2], m, w = vl->width - 1, h = vl->height - 1;
+  // frames since obj was last measured
+  gfloat k = motrack->since + 1;
+  for (int i=2; i--;) d[i] = lroundf(motrack->objects.vel[obj][i] * k);
+  // faster objects get more room to change course
+  m = motrack->speed + MAX(ABS(d[0]), ABS(d[1]));
+  for (int i=6; i--;)
+    pred[i] = CLAMP((gint) found[i] + d[i & 1], 0, i & 1 ? h : w);
+  win[0] = CLAMP((gint) pred[0] - m, 0, w);
+  win[1] = CLAMP((gint) pred[1] - m, 0, h);
+  win[2] = CLAMP((gint) pred[2] + m, 0, w);
+  win[3] = CLAMP((gint) pred[3] + m, 0, h);
+}
+
+static void follow_motion(GstMotrack *motrack, guint obj, guint *old)
+/* constant velocity model: blend the step obj just took into its */
+/* velocity, a steady state Kalman filter for a noisy position */
+{
+  gfloat k = motrack->since + 1, *vel = motrack->objects.vel[obj];
+  for (int i=2; i--;){
+    gfloat step = ((gfloat) motrack->objects.found[obj][4 + i] - old[i]) / k;
+    vel[i] += MOTION_GAIN * (step - vel[i]);
   }
-  // already detected?
-  for (int o=MAX_OBJECTS; o--;){
-    if (o==obj || !motrack->obj_found[o][3]) continue;
-    if (motrack->obj_found[o][0]>=rect[0]-sz
-      && motrack->obj_found[o][1]>=rect[1]-sz
-      && motrack->obj_found[o][2]<=rect[2]+sz
-      && motrack->obj_found[o][3]<=rect[3]+sz
-    ){ 
-        reject = TRUE;
-        break;
+}
+
+static void match_colors(GstMotrack *motrack, hkVidLayout *vl)
+/* match the whole frame, coarse to fine with a pyramid, or only this */
+/* frame's rescan strip and the known objects' search windows; rescan */
+/* takes precedence, strips are always matched at full size */
+{
+  hkObjects *os = &motrack->objects;
+  rescan_strip(motrack, vl);
+  if (motrack->rescan > 1){
+    hkVidLayout strip = *vl;
+    strip.clip[0] = motrack->strip[0], strip.clip[1] = motrack->strip[1];
+    maskClear(vl);
+    matchMask(&strip, &motrack->pool);
+    for (guint i=0; i<os->nlive; i++){
+      predict(motrack, vl, os->live[i]);
+      matchGrow(vl, os->win[os->live[i]], motrack->speed);
     }
+    return;
+  }
+  if (motrack->coarse.level != motrack->pyramid)
+    pyramidInit(&motrack->coarse, &motrack->layout, motrack->pyramid);
+  if (!motrack->coarse.level){
+    matchMask(vl, &motrack->pool);
+    return;
   }
-  return reject;
+  for (guint i=0; i<os->nlive; i++)
+    os->work[i] = os->found[os->live[i]];
+  pyramidMatch(vl, &motrack->coarse, os->work, os->nlive, &motrack->pool);
+}
+
+static gboolean is_reject(GstMotrack *motrack, guint *rect)
+{
+  // too small?
+  if (rect[2]-rect[0] < motrack->speed
+    || rect[3]-rect[1] < motrack->speed)
+    return TRUE;
+  // already detected?
+  return objectsCover(&motrack->objects, rect, motrack->speed, OBJECTS_NONE);
+}
+
+static void keep_object(GstMotrack *motrack, guint obj, hkBlob *blob,
+  gint team)
+/* store blob measurements as object obj */
+{
+  guint *found = motrack->objects.found[obj];
+  memcpy(found, blob->rect, 4 * sizeof (guint));
+  rectCenter(found, &found[4]);
+  found[6] = team;
+  found[7] = blob->area;
+  found[8] = blobDegrees(blob);
+  objectMoved(&motrack->objects, obj);
 }
 
 static void scan_for_objects(GstMotrack *motrack, hkVidLayout *vl)
-/* search video frame and count any colored objects */
-{
-  guint size = motrack->speed,
-    max = motrack->max_objects,
-    rect[4]={0}, *center,
-    available = 0;
-  for (int i=0; i<vl->height && motrack->obj_count < max; i+=size){
-    for (int j=0;j<vl->width && motrack->obj_count < max; j+=size){
-      if (matchColor(vl, j, i, motrack->yuv0)){
-        // measure bounds of detected object
-        getBounds(vl, j, i, rect);
-        if (is_reject(motrack, rect, MAX_OBJECTS)){
-          rect[3] = 0; continue;
-        }
-        center = rectCenter(rect);
-        // find an available obj_found storage location
-        for (int i=0; i<max; i++){
-          if (!motrack->obj_found[i][3]){
-            available = i;
-            break;
-          }
-        }
-        for (int r=4; r--;){
-          motrack->obj_found[available][r] = rect[r];
-          rect[r] = 0;
-        }
-        motrack->obj_found[available][4] = center[0];
-        motrack->obj_found[available][5] = center[1];
-        motrack->obj_count++;
-      }
-    }
+/* count any new colored objects among this frame's blobs */
+{
+  hkObjects *os = &motrack->objects;
+  hkBlob *blob;
+  gint team;
+  for (guint b=0; b<motrack->blobs.nblobs && os->nlive < motrack->max_objects;
+    b++){
+    blob = &motrack->blobs.blob[b];
+    // objects start with color0, in a blob no object took
+    if (!blob->seeds || os->owner[b] != OBJECTS_NONE) continue;
+    if (is_reject(motrack, blob->rect)
+      || (team = teamOf(vl, &motrack->table, blob->rect)) < 0)
+      continue;
+    keep_object(motrack, objectNew(os), blob, team);
   }
 }
 
 static void motrack_objects(GstMotrack *motrack, hkVidLayout *vl)
 /* Follows existing objects as they move about. */
-/* Attempts to keep persistent motracking numbers assigned. */
-{
-  guint *rect, *center;
-  for (int obj = 0; obj < MAX_OBJECTS; obj++){
-    rect = motrack->obj_found[obj];
-    if (!rect[3]) continue; // next
-    // clear old rect
-    for (int i=4; i--;) rect[i] = 0;
-    // get new bounds
-    getBounds(vl, rect[4], rect[5], rect);
-    // check validity
-    if (is_reject(motrack, rect, obj)){
-      // reject; wipe it
-      motrack->obj_count--;
-      rect[3] = 0; continue; // next
+/* Re-acquires them by flood fill from where they should be, then */
+/* pairs each with the blob overlapping and nearest that spot, so */
+/* objects keep their tracking numbers even as they cross; one left */
+/* without a blob coasts along for up to coast frames before it is lost. */
+{
+  hkObjects *os = &motrack->objects;
+  guint *found, old[2], obj, b;
+  gint team;
+  for (guint i=0; i<os->nlive; i++){
+    predict(motrack, vl, os->live[i]);
+    os->work[i] = os->pred[os->live[i]];
+  }
+  // flood fill from where known objects should be, then label the rest
+  blobsSeek(vl, &motrack->blobs, os->work, os->nlive);
+  labelBlobs(vl, &motrack->blobs, &motrack->pool);
+  objectsAssign(os, &motrack->blobs, motrack->speed);
+  // backwards, as a dropped object's place goes to one already done
+  for (guint i=os->nlive; i--;){
+    obj = os->live[i], b = os->match[obj];
+    found = os->found[obj];
+    old[0] = found[4], old[1] = found[5];
+    if (b != OBJECTS_NONE && (team = teamOf(vl, &motrack->table,
+      motrack->blobs.blob[b].rect)) >= 0){
+      keep_object(motrack, obj, &motrack->blobs.blob[b], team);
+      follow_motion(motrack, obj, old);
+      os->coast[obj] = 0;
+      continue; // next
+    }
+    os->coast[obj] += motrack->since + 1;
+    if (os->coast[obj] > motrack->coast){
+      // lost; wipe it
+      objectDrop(os, obj);
+      continue; // next
     }
-    // get new center
-    center = rectCenter(rect);
-    rect[4] = center[0];
-    rect[5] = center[1];
+    memcpy(found, os->pred[obj], 6 * sizeof (guint));
+    objectMoved(os, obj);
   }
   scan_for_objects(motrack, vl);
 }
 
-static void report_objects(GstMotrack *motrack, hkVidLayout *vl)
+static void mark_object(GstMotrack *motrack, hkVidLayout *vl, guint *prect,
+  guint npts)
+/* mark one object with the chosen mark method */
+{
+  guint8 *mcolor = motrack->mcyuv;
+  guint *center = &prect[4];
+  switch (motrack->mark_method){
+    case GST_MOTRACK_MARK_METHOD_BOX:
+      box(vl, prect, mcolor);
+      break;
+    case GST_MOTRACK_MARK_METHOD_BOTH:
+      box(vl, prect, mcolor);
+    case GST_MOTRACK_MARK_METHOD_CROSSHAIRS:
+      crosshairs(vl, center, mcolor);
+      break;
+    case GST_MOTRACK_MARK_METHOD_CLOAK:
+      cloak(vl, prect);
+      break;
+    case GST_MOTRACK_MARK_METHOD_BLUR:
+      blur(vl, prect, motrack->speed);
+      break;
+    case GST_MOTRACK_MARK_METHOD_BLUR8:
+      blur(vl, prect, 8);
+      break;
+    case GST_MOTRACK_MARK_METHOD_EDGE:
+      edge(vl, prect, mcolor, FALSE);
+      break;
+    case GST_MOTRACK_MARK_METHOD_CANNY:
+      edge(vl, prect, mcolor, TRUE);
+      break;
+    case GST_MOTRACK_MARK_METHOD_OUTLINE:
+      outline(vl, motrack->poly.pt, npts, mcolor);
+      break;
+    case GST_MOTRACK_MARK_METHOD_DECIMATE:
+      decimate(vl, prect, motrack->speed);
+      break;
+    case GST_MOTRACK_MARK_METHOD_COLORIZE:
+      colorize(vl, prect, mcolor);
+      break;
+    default:
+      break;
+  }
+}
+
+static gboolean mark_in_bands(GstMotrack *motrack)
+/* whether marks change only the rows they are given */
+/* blur, edge and outline read or draw across band edges, decimate */
+/* blocks straddle them and cloak borrows rows from other bands */
+{
+  switch (motrack->mark_method){
+    case GST_MOTRACK_MARK_METHOD_BOX:
+    case GST_MOTRACK_MARK_METHOD_BOTH:
+    case GST_MOTRACK_MARK_METHOD_CROSSHAIRS:
+    case GST_MOTRACK_MARK_METHOD_COLORIZE:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+typedef struct _GstMotrackMarks
+{
+  GstMotrack *motrack;
+  hkVidLayout *vl;
+  guint **rects;
+  guint n;
+} GstMotrackMarks;
+
+static void mark_band(gpointer data, guint band, guint y0, guint y1)
+/* mark every object, changing rows y0..y1 only */
+{
+  GstMotrackMarks *m = data;
+  hkVidLayout vl = *m->vl;
+  vl.clip[0] = y0, vl.clip[1] = y1;
+  // each band gets its own slice of scratch
+  vl.scratch += band * vl.width * 4;
+  for (guint i=0; i<m->n; i++)
+    mark_object(m->motrack, &vl, m->rects[i], 0);
+}
+
+static void plate_band(gpointer data, guint band, guint y0, guint y1)
+/* learn the background around every object, rows y0..y1 only */
+{
+  GstMotrackMarks *m = data;
+  hkVidLayout vl = *m->vl;
+  vl.clip[0] = y0, vl.clip[1] = y1;
+  plateUpdate(&vl, m->rects, m->n, m->motrack->speed);
+}
+
+static gboolean analyze_frame(GstMotrack *motrack)
+/* whether to look for objects in this frame, or only move the marks */
+{
+  guint n = motrack->since + 1;
+  gfloat fastest = 0;
+  // nothing analyzed yet, or marks that read the match masks
+  if (!motrack->frame
+    || motrack->mark_method == GST_MOTRACK_MARK_METHOD_COLORIZE
+    || motrack->mark_method == GST_MOTRACK_MARK_METHOD_OUTLINE
+    || (motrack->message && motrack->polygon))
+    return TRUE;
+  if (motrack->interval) return n >= motrack->interval;
+  if (n >= ADAPTIVE_INTERVAL) return TRUE;
+  for (guint i=0; i<motrack->objects.nlive; i++){
+    gfloat *v = motrack->objects.vel[motrack->objects.live[i]];
+    fastest = MAX(fastest, MAX(fabsf(v[0]), fabsf(v[1])));
+  }
+  // look again before the fastest object can move half the minimum size
+  return 2 * fastest * n >= motrack->speed;
+}
+
+static guint *shown_rect(GstMotrack *motrack, hkVidLayout *vl, guint obj)
+/* obj as marked this frame: as measured on analyzed frames, else */
+/* moved along by its velocity and widened by the margin */
+{
+  guint *found = motrack->objects.found[obj],
+    *shown = motrack->objects.shown[obj];
+  gfloat *v = motrack->objects.vel[obj], k = motrack->since;
+  gint d[2], m, w = vl->width - 1, h = vl->height - 1;
+  if (!motrack->since) return found;
+  for (int i=2; i--;) d[i] = lroundf(v[i] * k);
+  m = lroundf(MAX(fabsf(v[0]), fabsf(v[1])) * k * motrack->margin / 100);
+  memcpy(shown, found, sizeof motrack->objects.shown[0]);
+  shown[0] = CLAMP((gint) found[0] + d[0] - m, 0, w);
+  shown[1] = CLAMP((gint) found[1] + d[1] - m, 0, h);
+  shown[2] = CLAMP((gint) found[2] + d[0] + m, 0, w);
+  shown[3] = CLAMP((gint) found[3] + d[1] + m, 0, h);
+  shown[4] = CLAMP((gint) found[4] + d[0], 0, w);
+  shown[5] = CLAMP((gint) found[5] + d[1], 0, h);
+  return shown;
+}
+
+static gboolean batch_wanted(GstMotrack *motrack)
+/* whether to post this frame's batched message: skip the frame while */
+/* pending posted ones are still waiting for the application's ack */
+{
+  gint backlog = motrack->sequence - g_atomic_int_get (&motrack->acked);
+  if (motrack->pending && backlog >= (gint) motrack->pending){
+    motrack->skipped++;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void post_batch(GstMotrack *motrack, GstClockTime stamp,
+  GstBuffer *objects, GArray *outlines)
+/* post one message for the whole frame, numbered for acks */
+{
+  GstMessage *msg;
+  GstStructure *s = gst_structure_new ("motrack-frame",
+    "timestamp", GST_TYPE_CLOCK_TIME, stamp,
+    "count", G_TYPE_UINT, motrack->objects.nlive,
+    "sequence", G_TYPE_UINT, ++motrack->sequence,
+    "skipped", G_TYPE_UINT, motrack->skipped,
+    "objects", GST_TYPE_BUFFER, objects,
+      NULL);
+  gst_buffer_unref (objects);
+  if (outlines){
+    gsize size = outlines->len * sizeof (guint32);
+    GstBuffer *buf = size ? gst_buffer_new_wrapped
+      (g_array_free (outlines, FALSE), size) : gst_buffer_new ();
+    if (!size) g_array_free (outlines, TRUE);
+    gst_structure_set (s, "polygons", GST_TYPE_BUFFER, buf, NULL);
+    gst_buffer_unref (buf);
+  }
+  msg = gst_message_new_element (GST_OBJECT_CAST (motrack), s);
+  gst_element_post_message (GST_ELEMENT_CAST (motrack), msg);
+  motrack->skipped = 0;
+}
+
+static void add_roi(GstMotrack *motrack, GstBuffer *buf, guint obj,
+  guint *prect)
+/* attach obj to this frame for downstream elements */
+{
+  guint *found = motrack->objects.found[obj];
+  GstVideoRegionOfInterestMeta *roi =
+    gst_buffer_add_video_region_of_interest_meta (buf, "motrack",
+      prect[0], prect[1], prect[2] - prect[0] + 1, prect[3] - prect[1] + 1);
+  roi->id = obj;
+  gst_video_region_of_interest_meta_add_param (roi,
+    gst_structure_new ("motrack",
+      "team", G_TYPE_UINT, found[6],
+      "area", G_TYPE_UINT, found[7],
+      "angle", G_TYPE_UINT, found[8],
+      "xc", G_TYPE_UINT, prect[4],
+      "yc", G_TYPE_UINT, prect[5],
+        NULL));
+}
+
+static void report_objects(GstMotrack *motrack, hkVidLayout *vl,
+  GstBuffer *buf)
 /* report object count, locations, optionally mark */
 {
   GstStructure *s;
-  guint8 *mcolor = motrack->mcyuv;
-  guint *prect, *center, obj = 0;
-  for (int c=motrack->obj_count; c--;){
-    do {
-      if (motrack->obj_found[obj][3]) break;
-      obj++;
-    } while (1);
-    prect = motrack->obj_found[obj], center = &motrack->obj_found[obj][4];
-    switch (motrack->mark_method){
-      case GST_MOTRACK_MARK_METHOD_BOX:
-        box(vl, prect, mcolor);
-        break;
-      case GST_MOTRACK_MARK_METHOD_BOTH:
-        box(vl, prect, mcolor);
-      case GST_MOTRACK_MARK_METHOD_CROSSHAIRS:
-        crosshairs(vl, center, mcolor);
-        break;
-      case GST_MOTRACK_MARK_METHOD_CLOAK:
-        cloak(vl, prect);
-        break;
-      case GST_MOTRACK_MARK_METHOD_BLUR:
-        blur(vl, prect, motrack->speed);
-        break;
-      case GST_MOTRACK_MARK_METHOD_BLUR8:
-        blur(vl, prect, 8);
-        break;
-      case GST_MOTRACK_MARK_METHOD_EDGE:
-        edge(vl, prect, mcolor);
-        break;
-      case GST_MOTRACK_MARK_METHOD_OUTLINE:
-        outline(vl, prect, mcolor);
-        break;
-      case GST_MOTRACK_MARK_METHOD_DECIMATE:
-        decimate(vl, prect, motrack->speed);
-        break;
-      case GST_MOTRACK_MARK_METHOD_COLORIZE:
-        colorize(vl, prect, mcolor);
-        break;
-      default:
-        break;
+  hkObjects *os = &motrack->objects;
+  guint *prect, *center, obj, npts = 0;
+  gboolean banded = mark_in_bands(motrack),
+    batch = motrack->message && motrack->batch,
+    report = motrack->message && (!batch || batch_wanted(motrack));
+  GstBuffer *objects = NULL;
+  GstMapInfo map = { 0, };
+  guint32 *words = NULL;
+  GArray *outlines = NULL;
+  for (guint i=0; i<os->nlive; i++)
+    os->work[i] = shown_rect(motrack, vl, os->live[i]);
+  // learn the background around the objects before cloaking them
+  if (motrack->mark_method == GST_MOTRACK_MARK_METHOD_CLOAK){
+    GstMotrackMarks m = {motrack, vl, os->work, os->nlive};
+    poolRun(&motrack->pool, plate_band, &m, vl->clip[0], vl->clip[1]);
+  }
+  if (banded){
+    GstMotrackMarks m = {motrack, vl, os->work, os->nlive};
+    poolRun(&motrack->pool, mark_band, &m, vl->clip[0], vl->clip[1]);
+  }
+  if (batch && report){
+    objects = gst_buffer_new_allocate (NULL, os->nlive * BATCH_WORDS
+      * sizeof (guint32), NULL);
+    if (objects && os->nlive
+        && gst_buffer_map (objects, &map, GST_MAP_WRITE))
+      words = (guint32 *) map.data;
+    else if (!objects || os->nlive){
+      // post nothing rather than fall back to per object messages
+      GST_WARNING_OBJECT (motrack,
+        "can't fill the batched message, not posting");
+      if (objects) gst_buffer_unref (objects);
+      objects = NULL, report = FALSE;
+      motrack->skipped++;
     }
-    if (motrack->message){
+    if (report && motrack->polygon)
+      outlines = g_array_new (FALSE, FALSE, sizeof (guint32));
+  }
+  for (guint i=0; i<os->nlive; i++){
+    obj = os->live[i];
+    prect = os->work[i];
+    center = &prect[4];
+    // trace the outline only when it is drawn or reported
+    if (motrack->mark_method == GST_MOTRACK_MARK_METHOD_OUTLINE
+      || (report && motrack->polygon))
+      npts = traceContour(vl, prect, &motrack->poly);
+    if (!banded) mark_object(motrack, vl, prect, npts);
+    add_roi(motrack, buf, obj, prect);
+    if (words){
+      guint32 *w = words + i * BATCH_WORDS, n = npts;
+      w[0] = obj;
+      for (int k=3; k--;) w[1 + k] = os->found[obj][6 + k];
+      for (int k=6; k--;) w[4 + k] = prect[k];
+      if (outlines){
+        g_array_append_val (outlines, n);
+        for (guint k=0; k<2*npts; k++){
+          n = motrack->poly.pt[k];
+          g_array_append_val (outlines, n);
+        }
+      }
+    } else if (report && !batch){
       s = gst_structure_new ("motrack",
-      "count", G_TYPE_UINT, motrack->obj_count,
+      "count", G_TYPE_UINT, os->nlive,
       "object", G_TYPE_UINT, obj,
+      "team", G_TYPE_UINT, os->found[obj][6],
+      "area", G_TYPE_UINT, os->found[obj][7],
+      "angle", G_TYPE_UINT, os->found[obj][8],
       "x1", G_TYPE_UINT, prect[0],
       "y1", G_TYPE_UINT, prect[1],
       "x2", G_TYPE_UINT, prect[2],
@@ -575,53 +1317,39 @@ static void report_objects(GstMotrack *motrack, hkVidLayout *vl)
       "xc", G_TYPE_UINT, center[0],
       "yc", G_TYPE_UINT, center[1],
         NULL);
+      if (motrack->polygon){
+        GValue pts = { 0, }, v = { 0, };
+        g_value_init (&pts, GST_TYPE_ARRAY);
+        g_value_init (&v, G_TYPE_UINT);
+        for (guint j=0; j<2*npts; j++){
+          g_value_set_uint (&v, motrack->poly.pt[j]);
+          gst_value_array_append_value (&pts, &v);
+        }
+        gst_structure_set_value (s, "polygon", &pts);
+        g_value_unset (&v);
+        g_value_unset (&pts);
+      }
       gst_element_post_message (GST_ELEMENT_CAST (motrack),
         gst_message_new_element (GST_OBJECT_CAST (motrack), s));
     }
-    obj++;
   }
+  if (words) gst_buffer_unmap (objects, &map);
+  if (objects) post_batch(motrack, GST_BUFFER_PTS (buf), objects, outlines);
 }
 
 static GstFlowReturn
-gst_motrack_filter_ip_planarY (GstVideoFilter2 * videofilter2,
-    GstBuffer * buf, int start, int end)
-{
-  GstMotrack *motrack = GST_MOTRACK (videofilter2);
-  hkVidLayout vl; hkgraphics_init(motrack, &vl, buf);
-  motrack_objects(motrack, &vl);
-  report_objects(motrack, &vl);
-  return GST_FLOW_OK;
-}
-
-static GstFlowReturn
-gst_motrack_filter_ip_YxYy (GstVideoFilter2 * videofilter2,
-    GstBuffer * buf, int start, int end)
-{
-  g_print("Fixme: YxYy\n");
-  return GST_FLOW_OK;
-}
-
-static GstFlowReturn
-gst_motrack_filter_ip_AYUV (GstVideoFilter2 * videofilter2,
-    GstBuffer * buf, int start, int end)
+gst_motrack_transform_frame_ip (GstVideoFilter * filter, GstVideoFrame * frame)
 {
-  g_print("Fixme: AYUV\n");
+  GstMotrack *motrack = GST_MOTRACK (filter);
+  hkVidLayout vl; hkgraphics_init(motrack, &vl, frame);
+  if (analyze_frame(motrack)){
+    match_colors(motrack, &vl);
+    motrack_objects(motrack, &vl);
+    motrack->since = 0;
+    motrack->frame++;
+  } else {
+    motrack->since++;
+  }
+  report_objects(motrack, &vl, frame->buffer);
   return GST_FLOW_OK;
 }
-
-static GstVideoFilter2Functions gst_motrack_filter_functions[] = {
-  {GST_VIDEO_FORMAT_I420, NULL, gst_motrack_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_YV12, NULL, gst_motrack_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_Y41B, NULL, gst_motrack_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_Y42B, NULL, gst_motrack_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_NV12, NULL, gst_motrack_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_NV21, NULL, gst_motrack_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_YUV9, NULL, gst_motrack_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_YVU9, NULL, gst_motrack_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_Y444, NULL, gst_motrack_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_UYVY, NULL, gst_motrack_filter_ip_YxYy},
-  {GST_VIDEO_FORMAT_YUY2, NULL, gst_motrack_filter_ip_YxYy},
-  {GST_VIDEO_FORMAT_YVYU, NULL, gst_motrack_filter_ip_YxYy},
-  {GST_VIDEO_FORMAT_AYUV, NULL, gst_motrack_filter_ip_AYUV},
-  {GST_VIDEO_FORMAT_UNKNOWN}
-};
@@ -20,8 +20,11 @@
 #ifndef _GST_MOTRACK_H_
 #define _GST_MOTRACK_H_
 
-#include <gst/videofilters/gstvideofilter2.h>
 #include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+#include "hkgraphics.h"
+#include "hkblob.h"
+#include "hkobjects.h"
 
 typedef enum {
   GST_MOTRACK_MARK_METHOD_NOTHING,
@@ -35,13 +38,14 @@ typedef enum {
   GST_MOTRACK_MARK_METHOD_EDGE,
   GST_MOTRACK_MARK_METHOD_OUTLINE,
   GST_MOTRACK_MARK_METHOD_COLORIZE,
+  GST_MOTRACK_MARK_METHOD_CANNY,
 } GstMotrackMarkMethod;
 
 #define RED   0xff0000
 #define GREEN 0x00ff00
 #define BLUE  0x0000ff
 #define WHITE 0x0ffffff
-#define MAX_OBJECTS 1024
+#define MAX_OBJECTS G_MAXUINT
 
 G_BEGIN_DECLS
 
@@ -53,7 +57,7 @@ G_BEGIN_DECLS
 
 typedef struct _GstMotrack
 {
-  GstVideoFilter2 video_filter2;
+  GstVideoFilter video_filter;
 
   /* properties */
   gboolean message;             /* whether to post messages */
@@ -67,20 +71,45 @@ typedef struct _GstMotrack
   guint threshold;              /* color motracking threshold */
   guint max_objects;            /* number of objects to motrack */
   guint mark_method;            /* mark method */
+  gchar *colors;                /* extra colors, see hkmatch.h */
+  gchar *teams;                 /* team color profiles */
+  gboolean polygon;             /* whether messages carry outlines */
+  guint threads;                /* bands per frame, 0 = one per CPU */
+  guint pyramid;                /* coarse detection levels, 0 = off */
+  gboolean chroma;              /* match at chroma resolution */
+  guint rescan;                 /* frames per search for new objects */
+  guint interval;               /* analyze every nth frame, 0 = adaptive */
+  guint margin;                 /* percent of predicted travel to pad */
+  guint coast;                  /* frames a lost object keeps its number */
+  gboolean batch;               /* one message per frame, not per object */
+  guint pending;                /* unacknowledged messages before skipping */
+  gint acked;                   /* last batched message the app handled */
 
   /* state */
   guint *rect;                  /* bounding box of motracked object */
-  guint8 yuv0[3];              /* background color YUV */
+  guint8 yuv0[3];              /* background color, in frame space */
   guint8 yuv1[3];
   guint8 yuv2[3];
   guint8 mcyuv[3];
-  guint obj_found[MAX_OBJECTS][6]; /* array of found objects */
-  guint obj_count;
+  hkVidLayout layout;           /* frame geometry, set with caps */
+  hkColorTable table;           /* all tracking colors */
+  gboolean table_dirty;         /* colors changed, rebuild table */
+  gboolean mcolor_dirty;        /* mark color changed, convert it */
+  hkBlobs blobs;                /* this frame's labeled blobs */
+  hkPolygon poly;               /* outline of the current object */
+  hkPool pool;                  /* band workers */
+  hkPyramid coarse;             /* downsampled frame for detection */
+  hkObjects objects;            /* tracked objects */
+  guint sequence;               /* last batched message posted */
+  guint skipped;                /* frames not posted since the last one */
+  guint frame;                  /* frames analyzed, picks rescan strip */
+  guint strip[2];               /* rows searched for new objects */
+  guint since;                  /* frames since the last analyzed one */
 } GstMotrack;
 
 typedef struct _GstMotrackClass
 {
-  GstVideoFilter2Class video_filter2_class;
+  GstVideoFilterClass video_filter_class;
 } GstMotrackClass;
 
 GType gst_motrack_get_type (void);
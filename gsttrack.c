@@ -41,11 +41,20 @@
  *   <para>
  *   #GstValue of #guint
  *   <classname>&quot;object&quot;</classname>:
- *   the temporary tracking number of each detected object.
- *   Note: Tracking numbers are initially assigned in top-down and
- *    left-to-right order. Track will attempt to assign the same
- *    tracking numbers to the same objects on each video frame,
- *    except if an object loses focus or leaves the frame.
+ *   the tracking number of each detected object.
+ *   Note: Tracking numbers are assigned in top-down and
+ *    left-to-right order as objects appear, and an object keeps its
+ *    number while it moves, even across another object's path. An
+ *    object that loses focus or leaves the frame keeps its number for
+ *    #GstTrack:coast frames, then gives it up.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;team&quot;</classname>:
+ *   the index of the #GstTrack:teams profile the object matched,
+ *   or 0 when no teams are set.
  *   </para>
  * </listitem>
  * <listitem>
@@ -63,12 +72,108 @@
  *   the x,y coordinates of the center of each detected object.
  *   </para>
  * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;area&quot;</classname>:
+ *   the number of pixels matching the object's colors.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;angle&quot;</classname>:
+ *   the direction of the object's long axis, in degrees 0-179
+ *   clockwise from horizontal.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValueArray of #guint
+ *   <classname>&quot;polygon&quot;</classname>:
+ *   x,y pairs of the vertices of the object's outline, clockwise,
+ *   only when the #GstTrack:polygon property is set.
+ *   </para>
+ * </listitem>
+ * </itemizedlist>
+ *
+ * Each object also rides along on its video buffer as a
+ * #GstVideoRegionOfInterestMeta of type &quot;track&quot;, its id the
+ * object's number, its box the object's box. Its &quot;track&quot;
+ * parameter structure holds the team, area, angle, xc and yc fields
+ * above, so downstream elements need not listen on the bus.
+ *
+ * With #GstTrack:mark set to nothing, track only reads the
+ * frame and runs in passthrough, so buffers shared with other
+ * branches, as after a tee, go on without being copied to be made
+ * writable. Such a buffer leaves with a new buffer header sharing
+ * the same memory, to carry the region of interest meta. Any other
+ * mark maps every frame for writing, whether or not anything is drawn
+ * on it, so a shared buffer is copied first.
+ *
+ * With many objects, one message per object can swamp an application's
+ * bus handler. When the #GstTrack:batch property is set, track instead posts
+ * one message per frame, named
+ *
+ * <classname>&quot;track-frame&quot;</classname>
+ *
+ * with these fields:
+ * <itemizedlist>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #GstClockTime
+ *   <classname>&quot;timestamp&quot;</classname>:
+ *   the timestamp of the frame.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;count&quot;</classname>:
+ *   Total number of detected objects on screen.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;sequence&quot;</classname>:
+ *   the message's number, counting from 1. An application that
+ *   falls behind hands it back through #GstTrack:acked once it is done
+ *   with the message, see #GstTrack:pending.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstValue of #guint
+ *   <classname>&quot;skipped&quot;</classname>:
+ *   frames since the previous message that were not posted because
+ *   #GstTrack:pending messages were still unacknowledged. Each
+ *   message holds every object, so the newest one stands for them.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstBuffer
+ *   <classname>&quot;objects&quot;</classname>:
+ *   ten native endian 32 bit words per object: object, team, area,
+ *   angle, x1, y1, x2, y2, xc, yc, as in the per object message.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstBuffer
+ *   <classname>&quot;polygons&quot;</classname>:
+ *   only when the #GstTrack:polygon property is set, each object's
+ *   outline in the same order, as 32 bit words: the number of
+ *   vertices, then their x,y pairs.
+ *   </para>
+ * </listitem>
  * </itemizedlist>
  *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
- * gst-launch -v v4l2src ! track ! autovideoconvert ! autovideosink
+ * gst-launch-1.0 -v v4l2src ! track ! autovideoconvert ! autovideosink
  * ]|
  * Insert track between video src and sink elements and set color 
  * properties. The trackable objects' primary, or background color 
@@ -79,8 +184,16 @@
  * players with black and blue markings on the field. Set the 
  * object's (player's) background color to blue and the foreground 
  * colors to black, and orange. Want to track the other team, too? 
- * No problem! Multiple instances of track may be added to the 
- * pipeline.
+ * No problem! List every team's colors in the #GstTrack:teams
+ * property, e.g. teams="0x0000ff,0x000000,0xff8000;0xff8000,0x000000,0x0000ff"
+ * and track labels each pixel once, tells the teams apart by their
+ * color1 and color2 markings, and reports each object's team.
+ *
+ * YUV, RGB and GRAY8 video are all tracked as they come. Colors are
+ * given in RGB either way and converted to the video's own space;
+ * Y-Y:U-U:V-V ranges stay YUV, and RGB pixels are converted to YUV
+ * to be tested against them. Gray video, from monochrome and
+ * infrared cameras, is matched on brightness alone.
  * </refsect2>
  */
 
@@ -94,6 +207,8 @@
 #include <math.h>
 #include "gsttrack.h"
 #include "hkgraphics.h"
+#include "hkmatch.h"
+#include "hkblob.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_track_debug_category);
 #define GST_CAT_DEFAULT gst_track_debug_category
@@ -108,15 +223,40 @@ static void gst_track_finalize (GObject * object);
 
 static gboolean gst_track_start (GstBaseTransform * trans);
 static gboolean gst_track_stop (GstBaseTransform * trans);
+static GstFlowReturn gst_track_prepare_output_buffer (
+    GstBaseTransform * trans, GstBuffer * input, GstBuffer ** outbuf);
+static gboolean gst_track_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query);
+static gboolean gst_track_set_info (GstVideoFilter * filter,
+    GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps,
+    GstVideoInfo * out_info);
 
 static GstFlowReturn
-gst_track_prefilter (GstVideoFilter2 * videofilter2, GstBuffer * buf);
+gst_track_transform_frame_ip (GstVideoFilter * filter, GstVideoFrame * frame);
 
-static GstVideoFilter2Functions gst_track_filter_functions[];
+/* pad templates */
+
+#define VIDEO_CAPS GST_VIDEO_CAPS_MAKE \
+    ("{ I420, YV12, Y41B, Y42B, NV12, NV21, YUV9, YVU9, Y444, " \
+    "YUY2, UYVY, YVYU, AYUV, RGBx, BGRx, xRGB, xBGR, GRAY8 }")
+
+static GstStaticPadTemplate gst_track_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS)
+    );
+
+static GstStaticPadTemplate gst_track_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS)
+    );
 
 /* class initialization */
 
-#define DEBUG_INIT(bla) \
+#define DEBUG_INIT \
   GST_DEBUG_CATEGORY_INIT (gst_track_debug_category, "track", 0, \
       "debug category for track element");
 
@@ -133,6 +273,7 @@ static const GEnumValue repace_methods[] = {
   {GST_TRACK_MARK_METHOD_DECIMATE, "Obscure (decimate, blocks)",
       "decimate"},
   {GST_TRACK_MARK_METHOD_EDGE, "Edge detect", "edge"},
+  {GST_TRACK_MARK_METHOD_CANNY, "Thin edges (Canny)", "canny"},
   {GST_TRACK_MARK_METHOD_OUTLINE, "Color outlines", "outline"},
   {GST_TRACK_MARK_METHOD_COLORIZE, "Colorize to marker color",
       "colorize"},
@@ -150,35 +291,40 @@ gst_track_mark_method_get_type (void)
   return repace_method_type;
 }
 
-GST_BOILERPLATE_FULL (GstTrack, gst_track, GstVideoFilter2,
-    GST_TYPE_VIDEO_FILTER2, DEBUG_INIT);
-
-static void
-gst_track_base_init (gpointer g_class)
-{
-  GstElementClass *element_class = GST_ELEMENT_CLASS (g_class);
-  gst_element_class_set_details_simple (element_class, "Object tracking / marking",
-      "Filter/Tracking",
-      "The track element tracks and optionally marks areas of color in a video stream.",
-    "Henry Kroll III, www.thenerdshow.com");
-}
+G_DEFINE_TYPE_WITH_CODE (GstTrack, gst_track, GST_TYPE_VIDEO_FILTER,
+    DEBUG_INIT);
 
 static void
 gst_track_class_init (GstTrackClass * klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
-  GstVideoFilter2Class *video_filter2_class = GST_VIDEO_FILTER2_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstVideoFilterClass *video_filter_class = GST_VIDEO_FILTER_CLASS (klass);
   GstBaseTransformClass *base_transform_class =
       GST_BASE_TRANSFORM_CLASS (klass);
 
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_track_sink_template);
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_track_src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Object tracking / marking",
+      "Filter/Tracking",
+      "The track element tracks and optionally marks areas of color in a video stream.",
+    "Henry Kroll III, www.thenerdshow.com");
+
   gobject_class->set_property = gst_track_set_property;
   gobject_class->get_property = gst_track_get_property;
   gobject_class->finalize = gst_track_finalize;
   base_transform_class->start = GST_DEBUG_FUNCPTR (gst_track_start);
   base_transform_class->stop = GST_DEBUG_FUNCPTR (gst_track_stop);
-
-  video_filter2_class->prefilter =
-      GST_DEBUG_FUNCPTR (gst_track_prefilter);
+  base_transform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_track_propose_allocation);
+  base_transform_class->prepare_output_buffer =
+      GST_DEBUG_FUNCPTR (gst_track_prepare_output_buffer);
+  video_filter_class->set_info = GST_DEBUG_FUNCPTR (gst_track_set_info);
+  video_filter_class->transform_frame_ip =
+      GST_DEBUG_FUNCPTR (gst_track_transform_frame_ip);
 
   g_object_class_install_property (gobject_class, PROP_MESSAGE,
       g_param_spec_boolean ("message", "message",
@@ -223,16 +369,100 @@ gst_track_class_init (GstTrackClass * klass)
           "Marker color RGB white=0xffffff", 0, G_MAXUINT,
           GREEN,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COLORS,
+      g_param_spec_string ("colors", "Extra Colors",
+          "More colors to track: RGB, RGB/threshold or Y-Y:U-U:V-V ranges,"
+          " e.g. skin tones 0-255:77-127:133-173", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_TEAMS,
+      g_param_spec_string ("teams", "Teams",
+          "Team color profiles to track in one pass, replacing color0-2:"
+          " color0,color1,color2;color0,color1,color2...", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POLYGON,
+      g_param_spec_boolean ("polygon", "Polygon",
+          "Include each object's outline polygon in its message",
+          DEFAULT_POLYGON, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Horizontal bands to process each frame in parallel,"
+          " 0 = one per CPU", 0, 64, DEFAULT_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PYRAMID,
+      g_param_spec_uint ("pyramid", "Pyramid",
+          "Find objects in a copy of the frame halved this many times"
+          " first, then refine them at full size; 0 = full size only."
+          " Not used while rescan is above 1", 0, 2, DEFAULT_PYRAMID,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_CHROMA,
+      g_param_spec_boolean ("chroma", "Chroma",
+          "Match colors once per chroma sample of subsampled formats,"
+          " trading edge accuracy for speed",
+          DEFAULT_CHROMA, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_RESCAN,
+      g_param_spec_uint ("rescan", "Rescan",
+          "Search for new objects a strip at a time over this many frames,"
+          " matching only around known objects in between, at full size"
+          " whatever pyramid is; 1 = whole frame every frame", 1, 1000,
+          DEFAULT_RESCAN,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_INTERVAL,
+      g_param_spec_uint ("interval", "Interval",
+          "Analyze every nth frame and move the marks along with the"
+          " objects in between; 0 = as often as the fastest object needs",
+          0, 100, DEFAULT_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MARGIN,
+      g_param_spec_uint ("margin", "Margin",
+          "Between analyzed frames, widen each box by this percent of"
+          " how far its object is predicted to have moved", 0, 1000,
+          DEFAULT_MARGIN, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COAST,
+      g_param_spec_uint ("coast", "Coast",
+          "Frames an object may go unseen, moving as predicted, before"
+          " its tracking number is given up", 0, 1000,
+          DEFAULT_COAST, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_BATCH,
+      g_param_spec_boolean ("batch", "Batch",
+          "Post one message per frame carrying every object, packed in"
+          " a buffer, instead of one message per object",
+          DEFAULT_BATCH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PENDING,
+      g_param_spec_uint ("pending", "Pending",
+          "Skip a frame's batched message while this many posted ones"
+          " are not yet acked, 0 = never skip", 0, 1000,
+          DEFAULT_PENDING, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_ACKED,
+      g_param_spec_uint ("acked", "Acked",
+          "Sequence number of the last batched message the application"
+          " has handled", 0, G_MAXUINT,
+          0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
 
-  gst_video_filter2_class_add_functions (video_filter2_class,
-      gst_track_filter_functions);
+static void set_passthrough (GstTrack *track)
+/* marks that change no pixels need only read the frame */
+{
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (track),
+      track->mark_method == GST_TRACK_MARK_METHOD_NOTHING);
 }
 
 static void
-gst_track_init (GstTrack * track,
-    GstTrackClass * track_class)
+gst_track_init (GstTrack * track)
 {
   track->message = DEFAULT_MESSAGE;
+  track->polygon = DEFAULT_POLYGON;
+  track->threads = DEFAULT_THREADS;
+  track->pyramid = DEFAULT_PYRAMID;
+  track->chroma = DEFAULT_CHROMA;
+  track->rescan = DEFAULT_RESCAN;
+  track->interval = DEFAULT_INTERVAL;
+  track->margin = DEFAULT_MARGIN;
+  track->coast = DEFAULT_COAST;
+  track->batch = DEFAULT_BATCH;
+  track->pending = DEFAULT_PENDING;
+  track->sequence = track->acked = 0;
+  track->skipped = 0;
+  poolInit (&track->pool);
   track->color0 = DEFAULT_COLOR;
   track->color1 = DEFAULT_COLOR;
   track->color2 = DEFAULT_COLOR;
@@ -240,9 +470,9 @@ gst_track_init (GstTrack * track,
   track->threshold = DEFAULT_THRESHOLD;
   track->max_objects = DEFAULT_MAX_OBJECTS;
   track->mark_method = DEFAULT_MARK_METHOD;
-  track->obj_count = 0;
-  for (int obj=MAX_OBJECTS; obj--;)
-    track->obj_found[obj][3] = 0;
+  set_passthrough (track);
+  track->table_dirty = track->mcolor_dirty = TRUE;
+  memset (&track->objects, 0, sizeof track->objects);
 }
 
 void
@@ -261,29 +491,88 @@ gst_track_set_property (GObject * object, guint property_id,
       track->size = g_value_get_uint(value);
       break;
     case PROP_BGCOLOR:
+      GST_OBJECT_LOCK (track);
       track->color0 = g_value_get_uint(value);
-      rgb2yuv(track->color0, track->bgyuv);
+      track->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (track);
       break;
     case PROP_FGCOLOR0:
+      GST_OBJECT_LOCK (track);
       track->color1 = g_value_get_uint(value);
-      rgb2yuv(track->color1, track->fgyuv0);
+      track->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (track);
       break;
     case PROP_FGCOLOR1:
+      GST_OBJECT_LOCK (track);
       track->color2 = g_value_get_uint(value);
-      rgb2yuv(track->color2, track->fgyuv1);
+      track->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (track);
       break;
     case PROP_MCOLOR:
+      GST_OBJECT_LOCK (track);
       track->mcolor = g_value_get_uint(value);
-      rgb2yuv(track->mcolor, track->mcyuv);
+      track->mcolor_dirty = TRUE;
+      GST_OBJECT_UNLOCK (track);
       break;
     case PROP_THRESHOLD:
+      GST_OBJECT_LOCK (track);
       track->threshold = g_value_get_uint(value);
+      track->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (track);
+      break;
+    case PROP_COLORS:
+      GST_OBJECT_LOCK (track);
+      g_free (track->colors);
+      track->colors = g_value_dup_string(value);
+      track->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (track);
+      break;
+    case PROP_TEAMS:
+      GST_OBJECT_LOCK (track);
+      g_free (track->teams);
+      track->teams = g_value_dup_string(value);
+      track->table_dirty = TRUE;
+      GST_OBJECT_UNLOCK (track);
+      break;
+    case PROP_POLYGON:
+      track->polygon = g_value_get_boolean(value);
+      break;
+    case PROP_THREADS:
+      track->threads = g_value_get_uint(value);
+      break;
+    case PROP_PYRAMID:
+      track->pyramid = g_value_get_uint(value);
+      break;
+    case PROP_CHROMA:
+      track->chroma = g_value_get_boolean(value);
+      break;
+    case PROP_RESCAN:
+      track->rescan = g_value_get_uint(value);
+      break;
+    case PROP_INTERVAL:
+      track->interval = g_value_get_uint(value);
+      break;
+    case PROP_MARGIN:
+      track->margin = g_value_get_uint(value);
+      break;
+    case PROP_COAST:
+      track->coast = g_value_get_uint(value);
+      break;
+    case PROP_BATCH:
+      track->batch = g_value_get_boolean(value);
+      break;
+    case PROP_PENDING:
+      track->pending = g_value_get_uint(value);
+      break;
+    case PROP_ACKED:
+      g_atomic_int_set (&track->acked, g_value_get_uint(value));
       break;
     case PROP_MAX_OBJECTS:
       track->max_objects = g_value_get_uint(value);
       break;
     case PROP_MARK_METHOD:
       track->mark_method = g_value_get_enum(value);
+      set_passthrough (track);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -322,6 +611,49 @@ gst_track_get_property (GObject * object, guint property_id,
     case PROP_THRESHOLD:
       g_value_set_uint (value, track->threshold);
       break;
+    case PROP_COLORS:
+      GST_OBJECT_LOCK (track);
+      g_value_set_string (value, track->colors);
+      GST_OBJECT_UNLOCK (track);
+      break;
+    case PROP_TEAMS:
+      GST_OBJECT_LOCK (track);
+      g_value_set_string (value, track->teams);
+      GST_OBJECT_UNLOCK (track);
+      break;
+    case PROP_POLYGON:
+      g_value_set_boolean (value, track->polygon);
+      break;
+    case PROP_THREADS:
+      g_value_set_uint (value, track->threads);
+      break;
+    case PROP_PYRAMID:
+      g_value_set_uint (value, track->pyramid);
+      break;
+    case PROP_CHROMA:
+      g_value_set_boolean (value, track->chroma);
+      break;
+    case PROP_RESCAN:
+      g_value_set_uint (value, track->rescan);
+      break;
+    case PROP_INTERVAL:
+      g_value_set_uint (value, track->interval);
+      break;
+    case PROP_MARGIN:
+      g_value_set_uint (value, track->margin);
+      break;
+    case PROP_COAST:
+      g_value_set_uint (value, track->coast);
+      break;
+    case PROP_BATCH:
+      g_value_set_boolean (value, track->batch);
+      break;
+    case PROP_PENDING:
+      g_value_set_uint (value, track->pending);
+      break;
+    case PROP_ACKED:
+      g_value_set_uint (value, g_atomic_int_get (&track->acked));
+      break;
     case PROP_MAX_OBJECTS:
       g_value_set_uint (value, track->max_objects);
       break;
@@ -337,11 +669,25 @@ gst_track_get_property (GObject * object, guint property_id,
 void
 gst_track_finalize (GObject * object)
 {
+  GstTrack *track;
+
   g_return_if_fail (GST_IS_TRACK (object));
+  track = GST_TRACK (object);
 
   /* clean up object here */
+  maskFree (&track->layout);
+  scratchFree (&track->layout);
+  plateFree (&track->layout);
+  tableFree (&track->table);
+  blobsFree (&track->blobs);
+  polygonFree (&track->poly);
+  poolFree (&track->pool);
+  pyramidFree (&track->coarse);
+  objectsFree (&track->objects);
+  g_free (track->colors);
+  g_free (track->teams);
 
-  G_OBJECT_CLASS (parent_class)->finalize (object);
+  G_OBJECT_CLASS (gst_track_parent_class)->finalize (object);
 }
 
 
@@ -357,170 +703,537 @@ gst_track_stop (GstBaseTransform * trans)
   return TRUE;
 }
 
+static gboolean
+gst_track_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+/* working in place, offer upstream the pools downstream picked, so */
+/* frames pass from one to the other uncopied, and accept video meta */
+/* for upstream's own plane layout */
+{
+  GstBufferPool *pool;
+  guint size, min, max;
+  if (decide_query){
+    for (guint i=0; i<gst_query_get_n_allocation_pools (decide_query); i++){
+      gst_query_parse_nth_allocation_pool (decide_query, i, &pool, &size,
+          &min, &max);
+      gst_query_add_allocation_pool (query, pool, size, min, max);
+      if (pool) gst_object_unref (pool);
+    }
+  }
+  if (!GST_BASE_TRANSFORM_CLASS (gst_track_parent_class)->propose_allocation
+      (trans, decide_query, query))
+    return FALSE;
+  gst_query_add_allocation_meta (query,
+      GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE, NULL);
+  return TRUE;
+}
+
 static GstFlowReturn
-gst_track_prefilter (GstVideoFilter2 * videofilter2, GstBuffer * buf)
+gst_track_prepare_output_buffer (GstBaseTransform * trans,
+    GstBuffer * input, GstBuffer ** outbuf)
+/* in passthrough, a buffer others still hold gets a header of its own */
+/* for the ROI meta; the copy shares the frame's memory, unwritten */
 {
-  return GST_FLOW_OK;
+  if (!gst_base_transform_is_passthrough (trans)
+      || gst_buffer_is_writable (input))
+    return GST_BASE_TRANSFORM_CLASS (gst_track_parent_class)->
+        prepare_output_buffer (trans, input, outbuf);
+  *outbuf = gst_buffer_copy (input);
+  return *outbuf ? GST_FLOW_OK : GST_FLOW_ERROR;
+}
+
+static void hkgraphics_layout (GstTrack *track, hkVidLayout *vl,
+  GstVideoInfo *info)
+/* cache frame geometry in hkVidLayout struct for hkgraphics library */
+/* called upon each caps change; each frame brings its own strides */
+{
+  vl->space = GST_VIDEO_INFO_IS_RGB (info) ? SPACE_RGB
+    : GST_VIDEO_INFO_IS_GRAY (info) ? SPACE_GRAY : SPACE_YUV;
+  vl->width = GST_VIDEO_INFO_WIDTH (info),
+  vl->height = GST_VIDEO_INFO_HEIGHT (info),
+  vl->size = GST_VIDEO_INFO_SIZE (info);
+  for (int i=3;i--;){
+    vl->offset[i] = GST_VIDEO_INFO_COMP_OFFSET (info, i);
+    vl->stride[i] = GST_VIDEO_INFO_COMP_STRIDE (info, i);
+    vl->pstride[i] = GST_VIDEO_INFO_COMP_PSTRIDE (info, i);
+    vl->pheight[i] = GST_VIDEO_INFO_COMP_HEIGHT (info, i);
+    vl->pwidth[i] = GST_VIDEO_INFO_COMP_WIDTH (info, i);
+    vl->wshift[i] = GST_VIDEO_FORMAT_INFO_W_SUB (info->finfo, i);
+    vl->hshift[i] = GST_VIDEO_FORMAT_INFO_H_SUB (info->finfo, i);
+  }
+  layoutInit(vl);
+}
+
+static gboolean
+gst_track_set_info (GstVideoFilter * filter, GstCaps * incaps,
+    GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
+{
+  GstTrack *track = GST_TRACK (filter);
+  hkgraphics_layout (track, &track->layout, in_info);
+  track->table_dirty = track->mcolor_dirty = TRUE;
+  maskInit (&track->layout);
+  scratchInit (&track->layout);
+  plateInit (&track->layout);
+  pyramidInit (&track->coarse, &track->layout, track->pyramid);
+  objectsInit (&track->objects, track->layout.width, track->layout.height);
+  return TRUE;
 }
 
-static void hkgraphics_init (GstTrack *track, hkVidLayout *vl, GstBuffer *buf)
-/* populate hkVidLayout struct for hkgraphics library */
+static void hkgraphics_init (GstTrack *track, hkVidLayout *vl,
+  GstVideoFrame *frame)
+/* point cached hkVidLayout struct at this frame for hkgraphics library */
 /* called upon each video frame */
 {
-  GstVideoFormat format = GST_VIDEO_FILTER2_FORMAT (track);
-  guint8 *gdata = GST_BUFFER_DATA (buf);
-  vl->width = GST_VIDEO_FILTER2_WIDTH (track),
-  vl->height = GST_VIDEO_FILTER2_HEIGHT (track),
+  // rebuild color table only after colors, threshold or caps change,
+  // with the colors in the frame's own color space
+  if (track->table_dirty){
+    guint8 *yuv[3] = {track->bgyuv, track->fgyuv0, track->fgyuv1};
+    guint space = track->layout.space;
+    GST_OBJECT_LOCK (track);
+    track->table_dirty = FALSE;
+    rgb2space(track->color0, space, track->bgyuv);
+    rgb2space(track->color1, space, track->fgyuv0);
+    rgb2space(track->color2, space, track->fgyuv1);
+    tableSetup(&track->table, yuv, track->threshold, track->colors,
+      track->teams, space);
+    GST_OBJECT_UNLOCK (track);
+  }
+  // the mark color is only drawn, not looked up in the table
+  if (track->mcolor_dirty){
+    GST_OBJECT_LOCK (track);
+    track->mcolor_dirty = FALSE;
+    rgb2space(track->mcolor, track->layout.space, track->mcyuv);
+    GST_OBJECT_UNLOCK (track);
+  }
+  if (track->table.nteams) classesInit(&track->layout);
+  *vl = track->layout;
   vl->threshold = track->threshold,
+  vl->chroma = track->chroma,
   vl->color0 = track->bgyuv,
   vl->color1 = track->fgyuv0;
   vl->color2 = track->fgyuv1;
+  // planes as mapped, with upstream's strides when it sent video meta
   for (int i=3;i--;){
-    vl->data[i] = gdata + gst_video_format_get_component_offset
-      (format, i, vl->width, vl->height);
-    vl->stride[i] = gst_video_format_get_row_stride
-      (format, i, vl->width);
-    vl->hscale[i] = vl->height /
-      gst_video_format_get_component_height (format, i, vl->height);
-    vl->wscale[i] = vl->width /
-      gst_video_format_get_component_width (format, i, vl->width);
+    vl->data[i] = GST_VIDEO_FRAME_COMP_DATA (frame, i);
+    vl->stride[i] = GST_VIDEO_FRAME_COMP_STRIDE (frame, i);
   }
+  vl->lut = track->table.lut;
+  vl->seed = track->table.seed;
+  if (!track->table.nteams) vl->classes = NULL;
+  // the whole frame; poolRun splits it into bands
+  vl->clip[0] = 0, vl->clip[1] = vl->height - 1;
+  poolThreads(&track->pool, track->threads);
 }
 
-static gboolean is_reject(GstTrack *track, guint *rect, guint obj)
+static void rescan_strip(GstTrack *track, hkVidLayout *vl)
+/* pick the rows searched for new objects this frame */
 {
-  gint sz = track->size;
-  gboolean reject = FALSE;
-  // too small?
-  if (rect[2]-rect[0] < track->size
-    || rect[3]-rect[1] < track->size){
-    reject = TRUE;
+  guint h = vl->clip[1] - vl->clip[0] + 1, n = MIN(track->rescan, h),
+    k = track->frame % n;
+  track->strip[0] = vl->clip[0] + h * k / n;
+  track->strip[1] = vl->clip[0] + h * (k + 1) / n - 1;
+}
+
+static void predict(GstTrack *track, hkVidLayout *vl, guint obj)
+/* where obj should be this frame if it keeps moving as it has: */
+/* its predicted box and center, and the box widened to a window */
+{
+  guint *found = track->objects.found[obj], *pred = track->objects.pred[obj],
+    *win = track->objects.win[obj];
+  gint d[2], m, w = vl->width - 1, h = vl->height - 1;
+  // frames since obj was last measured
+  gfloat k = track->since + 1;
+  for (int i=2; i--;) d[i] = lroundf(track->objects.vel[obj][i] * k);
+  // faster objects get more room to change course
+  m = track->size + MAX(ABS(d[0]), ABS(d[1]));
+  for (int i=6; i--;)
+    pred[i] = CLAMP((gint) found[i] + d[i & 1], 0, i & 1 ? h : w);
+  win[0] = CLAMP((gint) pred[0] - m, 0, w);
+  win[1] = CLAMP((gint) pred[1] - m, 0, h);
+  win[2] = CLAMP((gint) pred[2] + m, 0, w);
+  win[3] = CLAMP((gint) pred[3] + m, 0, h);
+}
+
+static void follow_motion(GstTrack *track, guint obj, guint *old)
+/* constant velocity model: blend the step obj just took into its */
+/* velocity, a steady state Kalman filter for a noisy position */
+{
+  gfloat k = track->since + 1, *vel = track->objects.vel[obj];
+  for (int i=2; i--;){
+    gfloat step = ((gfloat) track->objects.found[obj][4 + i] - old[i]) / k;
+    vel[i] += MOTION_GAIN * (step - vel[i]);
   }
-  // already detected?
-  for (int o=MAX_OBJECTS; o--;){
-    if (o==obj || !track->obj_found[o][3]) continue;
-    if (track->obj_found[o][0]>=rect[0]-sz
-      && track->obj_found[o][1]>=rect[1]-sz
-      && track->obj_found[o][2]<=rect[2]+sz
-      && track->obj_found[o][3]<=rect[3]+sz
-    ){ 
-        reject = TRUE;
-        break;
+}
+
+static void match_colors(GstTrack *track, hkVidLayout *vl)
+/* match the whole frame, coarse to fine with a pyramid, or only this */
+/* frame's rescan strip and the known objects' search windows; rescan */
+/* takes precedence, strips are always matched at full size */
+{
+  hkObjects *os = &track->objects;
+  rescan_strip(track, vl);
+  if (track->rescan > 1){
+    hkVidLayout strip = *vl;
+    strip.clip[0] = track->strip[0], strip.clip[1] = track->strip[1];
+    maskClear(vl);
+    matchMask(&strip, &track->pool);
+    for (guint i=0; i<os->nlive; i++){
+      predict(track, vl, os->live[i]);
+      matchGrow(vl, os->win[os->live[i]], track->size);
     }
+    return;
+  }
+  if (track->coarse.level != track->pyramid)
+    pyramidInit(&track->coarse, &track->layout, track->pyramid);
+  if (!track->coarse.level){
+    matchMask(vl, &track->pool);
+    return;
   }
-  return reject;
+  for (guint i=0; i<os->nlive; i++)
+    os->work[i] = os->found[os->live[i]];
+  pyramidMatch(vl, &track->coarse, os->work, os->nlive, &track->pool);
+}
+
+static gboolean is_reject(GstTrack *track, guint *rect)
+{
+  // too small?
+  if (rect[2]-rect[0] < track->size
+    || rect[3]-rect[1] < track->size)
+    return TRUE;
+  // already detected?
+  return objectsCover(&track->objects, rect, track->size, OBJECTS_NONE);
+}
+
+static void keep_object(GstTrack *track, guint obj, hkBlob *blob,
+  gint team)
+/* store blob measurements as object obj */
+{
+  guint *found = track->objects.found[obj];
+  memcpy(found, blob->rect, 4 * sizeof (guint));
+  rectCenter(found, &found[4]);
+  found[6] = team;
+  found[7] = blob->area;
+  found[8] = blobDegrees(blob);
+  objectMoved(&track->objects, obj);
 }
 
 static void scan_for_objects(GstTrack *track, hkVidLayout *vl)
-/* search video frame and count any colored objects */
-{
-  guint size = track->size,
-    max = track->max_objects,
-    rect[4]={0}, *center,
-    available = 0;
-  for (int i=0; i<vl->height && track->obj_count < max; i+=size){
-    for (int j=0;j<vl->width && track->obj_count < max; j+=size){
-      if (matchColor(vl, j, i, track->bgyuv)){
-        // measure bounds of detected object
-        getBounds(vl, j, i, rect);
-        if (is_reject(track, rect, MAX_OBJECTS)){
-          rect[3] = 0; continue;
-        }
-        center = rectCenter(rect);
-        // find an available obj_found storage location
-        for (int i=0; i<max; i++){
-          if (!track->obj_found[i][3]){
-            available = i;
-            break;
-          }
-        }
-        for (int r=4; r--;){
-          track->obj_found[available][r] = rect[r];
-          rect[r] = 0;
-        }
-        track->obj_found[available][4] = center[0];
-        track->obj_found[available][5] = center[1];
-        track->obj_count++;
-      }
-    }
+/* count any new colored objects among this frame's blobs */
+{
+  hkObjects *os = &track->objects;
+  hkBlob *blob;
+  gint team;
+  for (guint b=0; b<track->blobs.nblobs && os->nlive < track->max_objects;
+    b++){
+    blob = &track->blobs.blob[b];
+    // objects start with color0, in a blob no object took
+    if (!blob->seeds || os->owner[b] != OBJECTS_NONE) continue;
+    if (is_reject(track, blob->rect)
+      || (team = teamOf(vl, &track->table, blob->rect)) < 0)
+      continue;
+    keep_object(track, objectNew(os), blob, team);
   }
 }
 
 static void track_objects(GstTrack *track, hkVidLayout *vl)
 /* Follows existing objects as they move about. */
-/* Attempts to keep persistent tracking numbers assigned. */
-{
-  guint *rect, *center;
-  for (int obj = 0; obj < MAX_OBJECTS; obj++){
-    rect = track->obj_found[obj];
-    if (!rect[3]) continue; // next
-    // clear old rect
-    for (int i=4; i--;) rect[i] = 0;
-    // get new bounds
-    getBounds(vl, rect[4], rect[5], rect);
-    // check validity
-    if (is_reject(track, rect, obj)){
-      // reject; wipe it
-      track->obj_count--;
-      rect[3] = 0; continue; // next
+/* Re-acquires them by flood fill from where they should be, then */
+/* pairs each with the blob overlapping and nearest that spot, so */
+/* objects keep their tracking numbers even as they cross; one left */
+/* without a blob coasts along for up to coast frames before it is lost. */
+{
+  hkObjects *os = &track->objects;
+  guint *found, old[2], obj, b;
+  gint team;
+  for (guint i=0; i<os->nlive; i++){
+    predict(track, vl, os->live[i]);
+    os->work[i] = os->pred[os->live[i]];
+  }
+  // flood fill from where known objects should be, then label the rest
+  blobsSeek(vl, &track->blobs, os->work, os->nlive);
+  labelBlobs(vl, &track->blobs, &track->pool);
+  objectsAssign(os, &track->blobs, track->size);
+  // backwards, as a dropped object's place goes to one already done
+  for (guint i=os->nlive; i--;){
+    obj = os->live[i], b = os->match[obj];
+    found = os->found[obj];
+    old[0] = found[4], old[1] = found[5];
+    if (b != OBJECTS_NONE && (team = teamOf(vl, &track->table,
+      track->blobs.blob[b].rect)) >= 0){
+      keep_object(track, obj, &track->blobs.blob[b], team);
+      follow_motion(track, obj, old);
+      os->coast[obj] = 0;
+      continue; // next
+    }
+    os->coast[obj] += track->since + 1;
+    if (os->coast[obj] > track->coast){
+      // lost; wipe it
+      objectDrop(os, obj);
+      continue; // next
     }
-    // get new center
-    center = rectCenter(rect);
-    rect[4] = center[0];
-    rect[5] = center[1];
+    memcpy(found, os->pred[obj], 6 * sizeof (guint));
+    objectMoved(os, obj);
   }
   scan_for_objects(track, vl);
 }
 
-static void report_objects(GstTrack *track, hkVidLayout *vl)
+static void mark_object(GstTrack *track, hkVidLayout *vl, guint *prect,
+  guint npts)
+/* mark one object with the chosen mark method */
+{
+  guint8 *mcolor = track->mcyuv;
+  guint *center = &prect[4];
+  switch (track->mark_method){
+    case GST_TRACK_MARK_METHOD_BOX:
+      box(vl, prect, mcolor);
+      break;
+    case GST_TRACK_MARK_METHOD_BOTH:
+      box(vl, prect, mcolor);
+    case GST_TRACK_MARK_METHOD_CROSSHAIRS:
+      crosshairs(vl, center, mcolor);
+      break;
+    case GST_TRACK_MARK_METHOD_CLOAK:
+      cloak(vl, prect);
+      break;
+    case GST_TRACK_MARK_METHOD_BLUR:
+      blur(vl, prect, track->size);
+      break;
+    case GST_TRACK_MARK_METHOD_BLUR8:
+      blur(vl, prect, 8);
+      break;
+    case GST_TRACK_MARK_METHOD_EDGE:
+      edge(vl, prect, mcolor, FALSE);
+      break;
+    case GST_TRACK_MARK_METHOD_CANNY:
+      edge(vl, prect, mcolor, TRUE);
+      break;
+    case GST_TRACK_MARK_METHOD_OUTLINE:
+      outline(vl, track->poly.pt, npts, mcolor);
+      break;
+    case GST_TRACK_MARK_METHOD_DECIMATE:
+      decimate(vl, prect, track->size);
+      break;
+    case GST_TRACK_MARK_METHOD_COLORIZE:
+      colorize(vl, prect, mcolor);
+      break;
+    default:
+      break;
+  }
+}
+
+static gboolean mark_in_bands(GstTrack *track)
+/* whether marks change only the rows they are given */
+/* blur, edge and outline read or draw across band edges, decimate */
+/* blocks straddle them and cloak borrows rows from other bands */
+{
+  switch (track->mark_method){
+    case GST_TRACK_MARK_METHOD_BOX:
+    case GST_TRACK_MARK_METHOD_BOTH:
+    case GST_TRACK_MARK_METHOD_CROSSHAIRS:
+    case GST_TRACK_MARK_METHOD_COLORIZE:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+typedef struct _GstTrackMarks
+{
+  GstTrack *track;
+  hkVidLayout *vl;
+  guint **rects;
+  guint n;
+} GstTrackMarks;
+
+static void mark_band(gpointer data, guint band, guint y0, guint y1)
+/* mark every object, changing rows y0..y1 only */
+{
+  GstTrackMarks *m = data;
+  hkVidLayout vl = *m->vl;
+  vl.clip[0] = y0, vl.clip[1] = y1;
+  // each band gets its own slice of scratch
+  vl.scratch += band * vl.width * 4;
+  for (guint i=0; i<m->n; i++)
+    mark_object(m->track, &vl, m->rects[i], 0);
+}
+
+static void plate_band(gpointer data, guint band, guint y0, guint y1)
+/* learn the background around every object, rows y0..y1 only */
+{
+  GstTrackMarks *m = data;
+  hkVidLayout vl = *m->vl;
+  vl.clip[0] = y0, vl.clip[1] = y1;
+  plateUpdate(&vl, m->rects, m->n, m->track->size);
+}
+
+static gboolean analyze_frame(GstTrack *track)
+/* whether to look for objects in this frame, or only move the marks */
+{
+  guint n = track->since + 1;
+  gfloat fastest = 0;
+  // nothing analyzed yet, or marks that read the match masks
+  if (!track->frame || track->mark_method == GST_TRACK_MARK_METHOD_COLORIZE
+    || track->mark_method == GST_TRACK_MARK_METHOD_OUTLINE
+    || (track->message && track->polygon))
+    return TRUE;
+  if (track->interval) return n >= track->interval;
+  if (n >= ADAPTIVE_INTERVAL) return TRUE;
+  for (guint i=0; i<track->objects.nlive; i++){
+    gfloat *v = track->objects.vel[track->objects.live[i]];
+    fastest = MAX(fastest, MAX(fabsf(v[0]), fabsf(v[1])));
+  }
+  // look again before the fastest object can move half the minimum size
+  return 2 * fastest * n >= track->size;
+}
+
+static guint *shown_rect(GstTrack *track, hkVidLayout *vl, guint obj)
+/* obj as marked this frame: as measured on analyzed frames, else */
+/* moved along by its velocity and widened by the margin */
+{
+  guint *found = track->objects.found[obj], *shown = track->objects.shown[obj];
+  gfloat *v = track->objects.vel[obj], k = track->since;
+  gint d[2], m, w = vl->width - 1, h = vl->height - 1;
+  if (!track->since) return found;
+  for (int i=2; i--;) d[i] = lroundf(v[i] * k);
+  m = lroundf(MAX(fabsf(v[0]), fabsf(v[1])) * k * track->margin / 100);
+  memcpy(shown, found, sizeof track->objects.shown[0]);
+  shown[0] = CLAMP((gint) found[0] + d[0] - m, 0, w);
+  shown[1] = CLAMP((gint) found[1] + d[1] - m, 0, h);
+  shown[2] = CLAMP((gint) found[2] + d[0] + m, 0, w);
+  shown[3] = CLAMP((gint) found[3] + d[1] + m, 0, h);
+  shown[4] = CLAMP((gint) found[4] + d[0], 0, w);
+  shown[5] = CLAMP((gint) found[5] + d[1], 0, h);
+  return shown;
+}
+
+static gboolean batch_wanted(GstTrack *track)
+/* whether to post this frame's batched message: skip the frame while */
+/* pending posted ones are still waiting for the application's ack */
+{
+  gint backlog = track->sequence - g_atomic_int_get (&track->acked);
+  if (track->pending && backlog >= (gint) track->pending){
+    track->skipped++;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void post_batch(GstTrack *track, GstClockTime stamp,
+  GstBuffer *objects, GArray *outlines)
+/* post one message for the whole frame, numbered for acks */
+{
+  GstMessage *msg;
+  GstStructure *s = gst_structure_new ("track-frame",
+    "timestamp", GST_TYPE_CLOCK_TIME, stamp,
+    "count", G_TYPE_UINT, track->objects.nlive,
+    "sequence", G_TYPE_UINT, ++track->sequence,
+    "skipped", G_TYPE_UINT, track->skipped,
+    "objects", GST_TYPE_BUFFER, objects,
+      NULL);
+  gst_buffer_unref (objects);
+  if (outlines){
+    gsize size = outlines->len * sizeof (guint32);
+    GstBuffer *buf = size ? gst_buffer_new_wrapped
+      (g_array_free (outlines, FALSE), size) : gst_buffer_new ();
+    if (!size) g_array_free (outlines, TRUE);
+    gst_structure_set (s, "polygons", GST_TYPE_BUFFER, buf, NULL);
+    gst_buffer_unref (buf);
+  }
+  msg = gst_message_new_element (GST_OBJECT_CAST (track), s);
+  gst_element_post_message (GST_ELEMENT_CAST (track), msg);
+  track->skipped = 0;
+}
+
+static void add_roi(GstTrack *track, GstBuffer *buf, guint obj,
+  guint *prect)
+/* attach obj to this frame for downstream elements */
+{
+  guint *found = track->objects.found[obj];
+  GstVideoRegionOfInterestMeta *roi =
+    gst_buffer_add_video_region_of_interest_meta (buf, "track",
+      prect[0], prect[1], prect[2] - prect[0] + 1, prect[3] - prect[1] + 1);
+  roi->id = obj;
+  gst_video_region_of_interest_meta_add_param (roi,
+    gst_structure_new ("track",
+      "team", G_TYPE_UINT, found[6],
+      "area", G_TYPE_UINT, found[7],
+      "angle", G_TYPE_UINT, found[8],
+      "xc", G_TYPE_UINT, prect[4],
+      "yc", G_TYPE_UINT, prect[5],
+        NULL));
+}
+
+static void report_objects(GstTrack *track, hkVidLayout *vl,
+  GstBuffer *buf)
 /* report object count, locations, optionally mark */
 {
   GstStructure *s;
-  guint8 *mcolor = track->mcyuv;
-  guint *prect, *center, obj = 0;
-  for (int c=track->obj_count; c--;){
-    do {
-      if (track->obj_found[obj][3]) break;
-      obj++;
-    } while (1);
-    prect = track->obj_found[obj], center = &track->obj_found[obj][4];
-    switch (track->mark_method){
-      case GST_TRACK_MARK_METHOD_BOX:
-        box(vl, prect, mcolor);
-        break;
-      case GST_TRACK_MARK_METHOD_BOTH:
-        box(vl, prect, mcolor);
-      case GST_TRACK_MARK_METHOD_CROSSHAIRS:
-        crosshairs(vl, center, mcolor);
-        break;
-      case GST_TRACK_MARK_METHOD_CLOAK:
-        cloak(vl, prect);
-        break;
-      case GST_TRACK_MARK_METHOD_BLUR:
-        blur(vl, prect, track->size);
-        break;
-      case GST_TRACK_MARK_METHOD_BLUR8:
-        blur(vl, prect, 8);
-        break;
-      case GST_TRACK_MARK_METHOD_EDGE:
-        edge(vl, prect, mcolor);
-        break;
-      case GST_TRACK_MARK_METHOD_OUTLINE:
-        outline(vl, prect, mcolor);
-        break;
-      case GST_TRACK_MARK_METHOD_DECIMATE:
-        decimate(vl, prect, track->size);
-        break;
-      case GST_TRACK_MARK_METHOD_COLORIZE:
-        colorize(vl, prect, mcolor);
-        break;
-      default:
-        break;
+  hkObjects *os = &track->objects;
+  guint *prect, *center, obj, npts = 0;
+  gboolean banded = mark_in_bands(track),
+    batch = track->message && track->batch,
+    report = track->message && (!batch || batch_wanted(track));
+  GstBuffer *objects = NULL;
+  GstMapInfo map = { 0, };
+  guint32 *words = NULL;
+  GArray *outlines = NULL;
+  for (guint i=0; i<os->nlive; i++)
+    os->work[i] = shown_rect(track, vl, os->live[i]);
+  // learn the background around the objects before cloaking them
+  if (track->mark_method == GST_TRACK_MARK_METHOD_CLOAK){
+    GstTrackMarks m = {track, vl, os->work, os->nlive};
+    poolRun(&track->pool, plate_band, &m, vl->clip[0], vl->clip[1]);
+  }
+  if (banded){
+    GstTrackMarks m = {track, vl, os->work, os->nlive};
+    poolRun(&track->pool, mark_band, &m, vl->clip[0], vl->clip[1]);
+  }
+  if (batch && report){
+    objects = gst_buffer_new_allocate (NULL, os->nlive * BATCH_WORDS
+      * sizeof (guint32), NULL);
+    if (objects && os->nlive
+        && gst_buffer_map (objects, &map, GST_MAP_WRITE))
+      words = (guint32 *) map.data;
+    else if (!objects || os->nlive){
+      // post nothing rather than fall back to per object messages
+      GST_WARNING_OBJECT (track,
+        "can't fill the batched message, not posting");
+      if (objects) gst_buffer_unref (objects);
+      objects = NULL, report = FALSE;
+      track->skipped++;
     }
-    if (track->message){
+    if (report && track->polygon)
+      outlines = g_array_new (FALSE, FALSE, sizeof (guint32));
+  }
+  for (guint i=0; i<os->nlive; i++){
+    obj = os->live[i];
+    prect = os->work[i];
+    center = &prect[4];
+    // trace the outline only when it is drawn or reported
+    if (track->mark_method == GST_TRACK_MARK_METHOD_OUTLINE
+      || (report && track->polygon))
+      npts = traceContour(vl, prect, &track->poly);
+    if (!banded) mark_object(track, vl, prect, npts);
+    add_roi(track, buf, obj, prect);
+    if (words){
+      guint32 *w = words + i * BATCH_WORDS, n = npts;
+      w[0] = obj;
+      for (int k=3; k--;) w[1 + k] = os->found[obj][6 + k];
+      for (int k=6; k--;) w[4 + k] = prect[k];
+      if (outlines){
+        g_array_append_val (outlines, n);
+        for (guint k=0; k<2*npts; k++){
+          n = track->poly.pt[k];
+          g_array_append_val (outlines, n);
+        }
+      }
+    } else if (report && !batch){
       s = gst_structure_new ("track",
-      "count", G_TYPE_UINT, track->obj_count,
+      "count", G_TYPE_UINT, os->nlive,
       "object", G_TYPE_UINT, obj,
+      "team", G_TYPE_UINT, os->found[obj][6],
+      "area", G_TYPE_UINT, os->found[obj][7],
+      "angle", G_TYPE_UINT, os->found[obj][8],
       "x1", G_TYPE_UINT, prect[0],
       "y1", G_TYPE_UINT, prect[1],
       "x2", G_TYPE_UINT, prect[2],
@@ -528,53 +1241,39 @@ static void report_objects(GstTrack *track, hkVidLayout *vl)
       "xc", G_TYPE_UINT, center[0],
       "yc", G_TYPE_UINT, center[1],
         NULL);
+      if (track->polygon){
+        GValue pts = { 0, }, v = { 0, };
+        g_value_init (&pts, GST_TYPE_ARRAY);
+        g_value_init (&v, G_TYPE_UINT);
+        for (guint j=0; j<2*npts; j++){
+          g_value_set_uint (&v, track->poly.pt[j]);
+          gst_value_array_append_value (&pts, &v);
+        }
+        gst_structure_set_value (s, "polygon", &pts);
+        g_value_unset (&v);
+        g_value_unset (&pts);
+      }
       gst_element_post_message (GST_ELEMENT_CAST (track),
         gst_message_new_element (GST_OBJECT_CAST (track), s));
     }
-    obj++;
   }
+  if (words) gst_buffer_unmap (objects, &map);
+  if (objects) post_batch(track, GST_BUFFER_PTS (buf), objects, outlines);
 }
 
 static GstFlowReturn
-gst_track_filter_ip_planarY (GstVideoFilter2 * videofilter2,
-    GstBuffer * buf, int start, int end)
-{
-  GstTrack *track = GST_TRACK (videofilter2);
-  hkVidLayout vl; hkgraphics_init(track, &vl, buf);
-  track_objects(track, &vl);
-  report_objects(track, &vl);
-  return GST_FLOW_OK;
-}
-
-static GstFlowReturn
-gst_track_filter_ip_YxYy (GstVideoFilter2 * videofilter2,
-    GstBuffer * buf, int start, int end)
-{
-  g_print("Fixme: YxYy\n");
-  return GST_FLOW_OK;
-}
-
-static GstFlowReturn
-gst_track_filter_ip_AYUV (GstVideoFilter2 * videofilter2,
-    GstBuffer * buf, int start, int end)
+gst_track_transform_frame_ip (GstVideoFilter * filter, GstVideoFrame * frame)
 {
-  g_print("Fixme: AYUV\n");
+  GstTrack *track = GST_TRACK (filter);
+  hkVidLayout vl; hkgraphics_init(track, &vl, frame);
+  if (analyze_frame(track)){
+    match_colors(track, &vl);
+    track_objects(track, &vl);
+    track->since = 0;
+    track->frame++;
+  } else {
+    track->since++;
+  }
+  report_objects(track, &vl, frame->buffer);
   return GST_FLOW_OK;
 }
-
-static GstVideoFilter2Functions gst_track_filter_functions[] = {
-  {GST_VIDEO_FORMAT_I420, NULL, gst_track_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_YV12, NULL, gst_track_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_Y41B, NULL, gst_track_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_Y42B, NULL, gst_track_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_NV12, NULL, gst_track_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_NV21, NULL, gst_track_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_YUV9, NULL, gst_track_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_YVU9, NULL, gst_track_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_Y444, NULL, gst_track_filter_ip_planarY},
-  {GST_VIDEO_FORMAT_UYVY, NULL, gst_track_filter_ip_YxYy},
-  {GST_VIDEO_FORMAT_YUY2, NULL, gst_track_filter_ip_YxYy},
-  {GST_VIDEO_FORMAT_YVYU, NULL, gst_track_filter_ip_YxYy},
-  {GST_VIDEO_FORMAT_AYUV, NULL, gst_track_filter_ip_AYUV},
-  {GST_VIDEO_FORMAT_UNKNOWN}
-};
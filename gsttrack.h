@@ -20,8 +20,11 @@
 #ifndef _GST_TRACK_H_
 #define _GST_TRACK_H_
 
-#include <gst/videofilters/gstvideofilter2.h>
 #include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+#include "hkgraphics.h"
+#include "hkblob.h"
+#include "hkobjects.h"
 
 enum
 {
@@ -35,6 +38,19 @@ enum
   PROP_MCOLOR,
   PROP_THRESHOLD,
   PROP_MAX_OBJECTS,
+  PROP_COLORS,
+  PROP_TEAMS,
+  PROP_POLYGON,
+  PROP_THREADS,
+  PROP_PYRAMID,
+  PROP_CHROMA,
+  PROP_RESCAN,
+  PROP_INTERVAL,
+  PROP_MARGIN,
+  PROP_COAST,
+  PROP_BATCH,
+  PROP_PENDING,
+  PROP_ACKED,
 };
 
 typedef enum {
@@ -49,6 +65,7 @@ typedef enum {
   GST_TRACK_MARK_METHOD_EDGE,
   GST_TRACK_MARK_METHOD_OUTLINE,
   GST_TRACK_MARK_METHOD_COLORIZE,
+  GST_TRACK_MARK_METHOD_CANNY,
 } GstTrackMarkMethod;
 
 #define RED   0xff0000
@@ -56,11 +73,24 @@ typedef enum {
 #define BLUE  0x0000ff
 #define WHITE 0x0ffffff
 #define DEFAULT_MESSAGE TRUE
+#define DEFAULT_POLYGON FALSE
+#define DEFAULT_THREADS 1
+#define DEFAULT_PYRAMID 0
+#define DEFAULT_CHROMA FALSE
+#define DEFAULT_RESCAN 1
+#define MOTION_GAIN 0.5f
+#define DEFAULT_INTERVAL 1
+#define DEFAULT_MARGIN 100
+#define DEFAULT_COAST 0
+#define DEFAULT_BATCH FALSE
+#define DEFAULT_PENDING 0
+#define BATCH_WORDS 10
+#define ADAPTIVE_INTERVAL 8
 #define DEFAULT_THRESHOLD 88
 #define DEFAULT_SIZE 20
 #define DEFAULT_MAX_OBJECTS 1
 #define DEFAULT_COLOR 0xFF0000
-#define MAX_OBJECTS 1024
+#define MAX_OBJECTS G_MAXUINT
 #define DEFAULT_MARK_METHOD GST_TRACK_MARK_METHOD_BOTH
 
 G_BEGIN_DECLS
@@ -73,7 +103,7 @@ G_BEGIN_DECLS
 
 typedef struct _GstTrack
 {
-  GstVideoFilter2 video_filter2;
+  GstVideoFilter video_filter;
 
   /* properties */
   gboolean message;             /* whether to post messages */
@@ -85,20 +115,45 @@ typedef struct _GstTrack
   guint threshold;              /* color tracking threshold */
   guint max_objects;            /* number of objects to track */
   guint mark_method;            /* mark method */
+  gchar *colors;                /* extra colors, see hkmatch.h */
+  gchar *teams;                 /* team color profiles */
+  gboolean polygon;             /* whether messages carry outlines */
+  guint threads;                /* bands per frame, 0 = one per CPU */
+  guint pyramid;                /* coarse detection levels, 0 = off */
+  gboolean chroma;              /* match at chroma resolution */
+  guint rescan;                 /* frames per search for new objects */
+  guint interval;               /* analyze every nth frame, 0 = adaptive */
+  guint margin;                 /* percent of predicted travel to pad */
+  guint coast;                  /* frames a lost object keeps its number */
+  gboolean batch;               /* one message per frame, not per object */
+  guint pending;                /* unacknowledged messages before skipping */
+  gint acked;                   /* last batched message the app handled */
 
   /* state */
   guint *rect;                  /* bounding box of tracked object */
-  guint8 bgyuv[3];              /* background color YUV */
+  guint8 bgyuv[3];              /* background color, in frame space */
   guint8 fgyuv0[3];
   guint8 fgyuv1[3];
   guint8 mcyuv[3];
-  guint obj_found[MAX_OBJECTS][6]; /* array of found objects */
-  guint obj_count;
+  hkVidLayout layout;           /* frame geometry, set with caps */
+  hkColorTable table;           /* all tracking colors */
+  gboolean table_dirty;         /* colors changed, rebuild table */
+  gboolean mcolor_dirty;        /* mark color changed, convert it */
+  hkBlobs blobs;                /* this frame's labeled blobs */
+  hkPolygon poly;               /* outline of the current object */
+  hkPool pool;                  /* band workers */
+  hkPyramid coarse;             /* downsampled frame for detection */
+  hkObjects objects;            /* tracked objects */
+  guint sequence;               /* last batched message posted */
+  guint skipped;                /* frames not posted since the last one */
+  guint frame;                  /* frames analyzed, picks rescan strip */
+  guint strip[2];               /* rows searched for new objects */
+  guint since;                  /* frames since the last analyzed one */
 } GstTrack;
 
 typedef struct _GstTrackClass
 {
-  GstVideoFilter2Class video_filter2_class;
+  GstVideoFilterClass video_filter_class;
 } GstTrackClass;
 
 GType gst_track_get_type (void);
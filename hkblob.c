@@ -0,0 +1,601 @@
+/* HKBlob
+ * Copyright (C) 2014 Henry Kroll, www.thenerdshow.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+/* Connected-component labeling over the MASK_ANY match mask. Each row
+ * is cut into runs of set bits, a word at a time; runs that touch a
+ * run on the row above (8-connected) are joined with union-find. One
+ * more pass over the runs gathers each blob's bounding box, area,
+ * centroid and second moments, all in time linear in the number of
+ * runs.
+ *
+ * Known objects are re-acquired first with a seeded scanline flood
+ * fill, which sets MASK_VISITED on every pixel it takes. Labeling and
+ * later fills skip visited pixels, so no pixel is examined twice in a
+ * frame however many objects overlap. The filled blobs then stand with
+ * the labeled ones when objects are paired with blobs, see hkobjects.c.
+ *
+ * With a pyramid, the frame is first sampled down 2x or 4x on each
+ * side, matched and labeled there, and only the neighborhoods of the
+ * coarse blobs are matched again at full resolution. Labeling the
+ * mostly empty full size masks then gives pixel-accurate boxes.
+ */
+//{
+#include <math.h>
+#include <string.h>
+#include "hkblob.h"
+
+static inline guint64 maskWord (const guint8 *row, guint w)
+/* 64 mask bits starting at pixel 64 * w; rows are padded to 64 bits */
+{
+  guint64 word;
+  memcpy (&word, row + 8 * w, 8);
+  return GUINT64_FROM_LE (word);
+}
+
+static inline guint64 freeWord (const guint8 *row, const guint8 *seen,
+  guint w)
+/* matching pixels not yet visited; seen may be NULL */
+{
+  guint64 word = maskWord (row, w);
+  return seen ? word & ~maskWord (seen, w) : word;
+}
+
+static guint nextBit (const guint8 *row, const guint8 *seen, guint x,
+  gboolean set, guint width)
+/* return first pixel >= x whose free bit is set (or clear), or width */
+{
+  guint w = x >> 6, words = (width + 63) >> 6;
+  guint64 flip = set ? 0 : ~G_GUINT64_CONSTANT (0), word;
+  if (x >= width) return width;
+  word = (freeWord (row, seen, w) ^ flip)
+    & (~G_GUINT64_CONSTANT (0) << (x & 63));
+  while (!word){
+    if (++w == words) return width;
+    word = freeWord (row, seen, w) ^ flip;
+  }
+  return MIN(w * 64 + __builtin_ctzll (word), width);
+}
+
+static guint runStart (const guint8 *row, const guint8 *seen, guint x)
+/* return first pixel of the free run ending at x, x must be free */
+{
+  guint w = x >> 6;
+  // clear bits, free pixels or not, right of x
+  guint64 word = ~freeWord (row, seen, w);
+  if ((x & 63) != 63) word &= ~(~G_GUINT64_CONSTANT (0) << ((x & 63) + 1));
+  while (!word){
+    if (!w--) return 0;
+    word = ~freeWord (row, seen, w);
+  }
+  return w * 64 + 64 - __builtin_clzll (word);
+}
+
+static void setBits (guint8 *row, guint x0, guint x1)
+/* set mask bits x0..x1 */
+{
+  for (guint w = x0 >> 6; w <= x1 >> 6; w++){
+    guint64 bits = ~G_GUINT64_CONSTANT (0), word;
+    if (w == x0 >> 6) bits &= ~G_GUINT64_CONSTANT (0) << (x0 & 63);
+    if (w == x1 >> 6 && (x1 & 63) != 63)
+      bits &= ~(~G_GUINT64_CONSTANT (0) << ((x1 & 63) + 1));
+    word = maskWord (row, w) | bits;
+    word = GUINT64_TO_LE (word);
+    memcpy (row + 8 * w, &word, 8);
+  }
+}
+
+static guint countBits (const guint8 *row, guint x0, guint x1)
+/* count set mask bits x0..x1 */
+{
+  guint n = 0;
+  for (guint w = x0 >> 6; w <= x1 >> 6; w++){
+    guint64 word = maskWord (row, w);
+    if (w == x0 >> 6) word &= ~G_GUINT64_CONSTANT (0) << (x0 & 63);
+    if (w == x1 >> 6 && (x1 & 63) != 63)
+      word &= ~(~G_GUINT64_CONSTANT (0) << ((x1 & 63) + 1));
+    n += __builtin_popcountll (word);
+  }
+  return n;
+}
+
+static inline guint findRoot (guint *parent, guint i)
+{
+  guint r = i;
+  while (parent[r] != r) r = parent[r];
+  // path compression
+  while (parent[i] != r){
+    guint next = parent[i];
+    parent[i] = r, i = next;
+  }
+  return r;
+}
+
+static inline void join (guint *parent, guint a, guint b)
+{
+  a = findRoot (parent, a), b = findRoot (parent, b);
+  if (a < b) parent[b] = a;
+  else if (b < a) parent[a] = b;
+}
+
+static inline guint64 sumSquares (guint64 n)
+/* 0^2 + 1^2 + ... + n^2 */
+{
+  return n * (n + 1) * (2 * n + 1) / 6;
+}
+
+static void addRun (hkVidLayout *vl, hkBlob *b, hkRun *r)
+/* add the pixels of run r to the bounding box and sums of blob b */
+{
+  guint n = r->x1 - r->x0 + 1;
+  guint64 sx = (guint64) n * (r->x0 + r->x1) / 2;
+  if (!b->area){
+    b->rect[0] = r->x0, b->rect[1] = r->y;
+    b->rect[2] = r->x1, b->rect[3] = r->y;
+  } else {
+    b->rect[0] = MIN(b->rect[0], r->x0);
+    b->rect[1] = MIN(b->rect[1], r->y);
+    b->rect[2] = MAX(b->rect[2], r->x1);
+    b->rect[3] = MAX(b->rect[3], r->y);
+  }
+  b->area += n;
+  b->seeds += countBits (vl->mask[MASK_COLOR0] + r->y * vl->mstride,
+      r->x0, r->x1);
+  b->sx += sx;
+  b->sy += (guint64) n * r->y;
+  b->sxx += sumSquares (r->x1) - (r->x0 ? sumSquares (r->x0 - 1) : 0);
+  b->syy += (guint64) n * r->y * r->y;
+  b->sxy += sx * r->y;
+}
+
+static void finishBlob (hkBlob *b)
+/* turn raw sums into centroid, moments and orientation */
+{
+  gdouble a = b->area;
+  b->cx = b->sx / a, b->cy = b->sy / a;
+  b->mxx = b->sxx / a - b->cx * b->cx;
+  b->myy = b->syy / a - b->cy * b->cy;
+  b->mxy = b->sxy / a - b->cx * b->cy;
+  b->angle = 0.5 * atan2 (2 * b->mxy, b->mxx - b->myy);
+}
+
+static void growRuns (hkBlobs *lb, guint need)
+{
+  if (need <= lb->maxruns) return;
+  while (lb->maxruns < need) lb->maxruns = MAX(lb->maxruns * 2, 1024);
+  lb->run = g_renew (hkRun, lb->run, lb->maxruns);
+  lb->label = g_renew (guint, lb->label, lb->maxruns);
+}
+
+static hkBlob *newBlob (hkBlobs *lb)
+/* append an empty blob */
+{
+  if (lb->nblobs == lb->maxblobs){
+    lb->maxblobs = MAX(lb->maxblobs * 2, 64);
+    lb->blob = g_renew (hkBlob, lb->blob, lb->maxblobs);
+  }
+  memset (&lb->blob[lb->nblobs], 0, sizeof (hkBlob));
+  return &lb->blob[lb->nblobs++];
+}
+
+static void joinRows (hkBlobs *lb, guint prev, guint cur, guint end)
+/* join runs cur..end-1 with the runs prev..cur-1 of the row above */
+{
+  guint j = prev;
+  for (guint i=cur; i<end; i++){
+    hkRun *r = &lb->run[i];
+    // runs above that touch this one, diagonals included
+    while (j < cur && lb->run[j].x1 + 1 < r->x0) j++;
+    for (guint k=j; k<cur && lb->run[k].x0 <= r->x1 + 1; k++)
+      join (lb->label, i, k);
+  }
+}
+
+static void labelRows (hkVidLayout *vl, hkBlobs *lb, guint y0, guint y1,
+  guint *rowstart)
+/* find and join the runs of rows y0..y1, numbering them from 0 */
+{
+  guint prev = 0, cur;
+  lb->nruns = 0, lb->y0 = y0, lb->y1 = y1;
+  for (guint y=y0; y<=y1; y++){
+    const guint8 *row = vl->mask[MASK_ANY] + y * vl->mstride,
+      *seen = vl->mask[MASK_VISITED] + y * vl->mstride;
+    guint x = 0;
+    rowstart[y] = cur = lb->nruns;
+    while ((x = nextBit (row, seen, x, TRUE, vl->width)) < vl->width){
+      hkRun *r;
+      growRuns (lb, lb->nruns + 1);
+      r = &lb->run[lb->nruns];
+      r->x0 = x, r->y = y;
+      r->x1 = x = nextBit (row, seen, x, FALSE, vl->width);
+      r->x1--;
+      lb->label[lb->nruns] = lb->nruns;
+      lb->nruns++;
+    }
+    joinRows (lb, prev, cur, lb->nruns);
+    prev = cur;
+  }
+}
+
+typedef struct _hkLabelJob
+{
+  hkVidLayout *vl;
+  hkBlobs *lb;
+} hkLabelJob;
+
+static void labelBand (gpointer data, guint band, guint y0, guint y1)
+{
+  hkLabelJob *job = data;
+  labelRows (job->vl, &job->lb->band[band], y0, y1, job->lb->rowstart);
+}
+
+void labelBlobs (hkVidLayout *vl, hkBlobs *lb, hkPool *pool)
+/* label connected blobs of matching, unvisited pixels in vl->clip rows */
+/* in parallel bands when pool is not NULL; blobsSeek's blobs stay first */
+{
+  guint y0 = vl->clip[0], y1 = vl->clip[1],
+    n = pool ? poolBands (pool, y0, y1) : 1, first = lb->nseeded;
+  if (lb->height != vl->height){
+    lb->height = vl->height;
+    lb->rowstart = g_renew (guint, lb->rowstart, vl->height + 1);
+  }
+  lb->nblobs = first, lb->nseeded = 0;
+  if (n <= 1){
+    labelRows (vl, lb, y0, y1, lb->rowstart);
+  } else {
+    hkLabelJob job = {vl, lb};
+    guint total = 0;
+    if (lb->nbands < n){
+      lb->band = g_renew (hkBlobs, lb->band, n);
+      memset (lb->band + lb->nbands, 0, (n - lb->nbands) * sizeof (hkBlobs));
+      lb->nbands = n;
+    }
+    poolRun (pool, labelBand, &job, y0, y1);
+    // reduction: append the bands in order, then join across the seams
+    for (guint b=0; b<n; b++) total += lb->band[b].nruns;
+    growRuns (lb, total);
+    lb->nruns = 0;
+    for (guint b=0; b<n; b++){
+      hkBlobs *band = &lb->band[b];
+      guint base = lb->nruns;
+      if (band->nruns)
+        memcpy (lb->run + base, band->run, band->nruns * sizeof (hkRun));
+      for (guint i=0; i<band->nruns; i++)
+        lb->label[base + i] = band->label[i] + base;
+      for (guint y=band->y0; y<=band->y1; y++)
+        lb->rowstart[y] += base;
+      lb->nruns += band->nruns;
+      if (b)
+        joinRows (lb, lb->rowstart[band->y0 - 1], base,
+          band->y0 < band->y1 ? lb->rowstart[band->y0 + 1] : lb->nruns);
+    }
+  }
+  // rows outside the clip hold no runs
+  for (guint y=0; y<y0; y++) lb->rowstart[y] = 0;
+  for (guint y=y1 + 1; y<=vl->height; y++) lb->rowstart[y] = lb->nruns;
+  // point every run straight at its root, the first run of its blob
+  for (guint i=0; i<lb->nruns; i++)
+    lb->label[i] = findRoot (lb->label, i);
+  // number blobs in raster order and gather their statistics
+  for (guint i=0; i<lb->nruns; i++){
+    guint root = lb->label[i];
+    if (root == i){
+      lb->label[i] = lb->nblobs;
+      newBlob (lb);
+    } else {
+      // roots come first, so the root already holds its blob index
+      lb->label[i] = lb->label[root];
+    }
+    addRun (vl, &lb->blob[lb->label[i]], &lb->run[i]);
+  }
+  for (guint i=first; i<lb->nblobs; i++)
+    finishBlob (&lb->blob[i]);
+}
+
+static void pushRun (hkBlobs *lb, guint *n, guint x0, guint x1, guint y)
+{
+  if (*n == lb->maxstack){
+    lb->maxstack = MAX(lb->maxstack * 2, 256);
+    lb->stack = g_renew (hkRun, lb->stack, lb->maxstack);
+  }
+  lb->stack[*n].x0 = x0, lb->stack[*n].x1 = x1, lb->stack[(*n)++].y = y;
+}
+
+static guint takeRun (hkVidLayout *vl, hkBlobs *lb, guint *n, guint x,
+  guint y)
+/* mark the free run through x on row y visited and push it */
+/* return the pixel after its end */
+{
+  const guint8 *row = vl->mask[MASK_ANY] + y * vl->mstride;
+  guint8 *seen = vl->mask[MASK_VISITED] + y * vl->mstride;
+  guint x0 = runStart (row, seen, x),
+    x1 = nextBit (row, seen, x, FALSE, vl->width);
+  setBits (seen, x0, x1 - 1);
+  pushRun (lb, n, x0, x1 - 1, y);
+  return x1;
+}
+
+gboolean fillBlob (hkVidLayout *vl, hkBlobs *lb, guint x, guint y,
+  hkBlob *blob)
+/* flood fill the blob through x,y, marking its pixels visited */
+/* return FALSE if x,y is not a free matching pixel */
+{
+  guint n = 0;
+  if (x >= vl->width || y >= vl->height
+    || !maskAt (vl, MASK_ANY, x, y) || maskAt (vl, MASK_VISITED, x, y))
+    return FALSE;
+  memset (blob, 0, sizeof *blob);
+  takeRun (vl, lb, &n, x, y);
+  while (n){
+    hkRun r = lb->stack[--n];
+    addRun (vl, blob, &r);
+    // free runs touching r above and below, diagonals included
+    for (gint dy = -1; dy <= 1; dy += 2){
+      guint ny = r.y + dy,
+        sx = r.x0 ? r.x0 - 1 : 0, ex = MIN(r.x1 + 2, vl->width);
+      const guint8 *row, *seen;
+      if (ny >= vl->height) continue;
+      row = vl->mask[MASK_ANY] + ny * vl->mstride;
+      seen = vl->mask[MASK_VISITED] + ny * vl->mstride;
+      while ((sx = nextBit (row, seen, sx, TRUE, vl->width)) < ex)
+        sx = takeRun (vl, lb, &n, sx, ny);
+    }
+  }
+  finishBlob (blob);
+  return TRUE;
+}
+
+gboolean seekBlob (hkVidLayout *vl, hkBlobs *lb, guint *rect,
+  guint *center, hkBlob *blob)
+/* re-acquire a blob from its old center, or failing that from */
+/* the first free matching pixel inside its old bounding box */
+{
+  if (fillBlob (vl, lb, center[0], center[1], blob)) return TRUE;
+  for (guint y=rect[1]; y<=rect[3] && y<vl->height; y++){
+    const guint8 *row = vl->mask[MASK_ANY] + y * vl->mstride,
+      *seen = vl->mask[MASK_VISITED] + y * vl->mstride;
+    guint x = nextBit (row, seen, rect[0], TRUE, vl->width);
+    if (x <= rect[2] && x < vl->width)
+      return fillBlob (vl, lb, x, y, blob);
+  }
+  return FALSE;
+}
+
+void blobsSeek (hkVidLayout *vl, hkBlobs *lb, guint **known, guint n)
+/* re-acquire n known objects, each a rect and its center, by flood */
+/* fill; call after matching and before labelBlobs, which keeps them */
+{
+  lb->nblobs = 0;
+  for (guint i=0; i<n; i++){
+    hkBlob *blob = newBlob (lb);
+    if (!seekBlob (vl, lb, known[i], &known[i][4], blob)) lb->nblobs--;
+  }
+  lb->nseeded = lb->nblobs;
+}
+
+guint blobDegrees (hkBlob *blob)
+/* major axis of blob in whole degrees 0..179, clockwise on screen */
+{
+  gint deg = lround (blob->angle * 180 / G_PI);
+  return (deg + 180) % 180;
+}
+
+void blobsFree (hkBlobs *lb)
+{
+  g_free (lb->run);
+  g_free (lb->label);
+  g_free (lb->rowstart);
+  g_free (lb->blob);
+  g_free (lb->stack);
+  for (guint b=0; b<lb->nbands; b++)
+    blobsFree (&lb->band[b]);
+  g_free (lb->band);
+  memset (lb, 0, sizeof *lb);
+}
+
+// Moore neighborhood, clockwise on screen starting east
+static const gint ndx[8] = {1, 1, 0, -1, -1, -1, 0, 1},
+  ndy[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+static inline gboolean setAt (hkVidLayout *vl, gint x, gint y)
+/* maskAt, with everything outside the frame unset */
+{
+  return x >= 0 && y >= 0 && x < (gint) vl->width && y < (gint) vl->height
+    && maskAt (vl, MASK_ANY, x, y);
+}
+
+static inline gint neighbor (gint dx, gint dy)
+/* direction of neighbor dx,dy */
+{
+  static const gint dirs[3][3] = {{5, 6, 7}, {4, -1, 0}, {3, 2, 1}};
+  return dirs[dy + 1][dx + 1];
+}
+
+static void addPoint (hkPolygon *poly, guint x, guint y)
+{
+  if (poly->npts == poly->maxpts){
+    poly->maxpts = MAX(poly->maxpts * 2, 256);
+    poly->pt = g_renew (guint, poly->pt, 2 * poly->maxpts);
+  }
+  poly->pt[2 * poly->npts] = x, poly->pt[2 * poly->npts + 1] = y;
+  poly->npts++;
+}
+
+static gdouble lineDistance (guint *pt, guint i, guint a, guint b)
+/* distance of vertex i from the line through vertices a and b */
+{
+  gdouble ax = pt[2*a], ay = pt[2*a+1], dx = pt[2*b] - ax,
+    dy = pt[2*b+1] - ay, len = sqrt (dx * dx + dy * dy);
+  if (len == 0) return hypot (pt[2*i] - ax, pt[2*i+1] - ay);
+  return fabs ((pt[2*i] - ax) * dy - (pt[2*i+1] - ay) * dx) / len;
+}
+
+static void simplify (hkPolygon *poly, gdouble tolerance)
+/* Douglas-Peucker: drop vertices closer than tolerance to the outline */
+{
+  guint n = poly->npts, far = 0, nspans = 0, j = 0;
+  gdouble best = -1;
+  if (n < 4) return;
+  poly->keep = g_renew (guint8, poly->keep, n);
+  poly->span = g_renew (guint, poly->span, 2 * n + 4);
+  memset (poly->keep, 0, n);
+  // split the closed outline at vertex 0 and the vertex farthest from it
+  for (guint i=1; i<n; i++){
+    gdouble d = hypot ((gdouble) poly->pt[2*i] - poly->pt[0],
+        (gdouble) poly->pt[2*i+1] - poly->pt[1]);
+    if (d > best) best = d, far = i;
+  }
+  poly->keep[0] = poly->keep[far] = 1;
+  poly->span[nspans++] = 0, poly->span[nspans++] = far;
+  poly->span[nspans++] = far, poly->span[nspans++] = n;
+  while (nspans){
+    guint b = poly->span[--nspans], a = poly->span[--nspans], split = a;
+    gdouble worst = tolerance;
+    for (guint i=a+1; i<b; i++){
+      gdouble d = lineDistance (poly->pt, i, a, b % n);
+      if (d > worst) worst = d, split = i;
+    }
+    if (split == a) continue;
+    poly->keep[split] = 1;
+    poly->span[nspans++] = a, poly->span[nspans++] = split;
+    poly->span[nspans++] = split, poly->span[nspans++] = b;
+  }
+  for (guint i=0; i<n; i++){
+    if (!poly->keep[i]) continue;
+    poly->pt[2*j] = poly->pt[2*i], poly->pt[2*j+1] = poly->pt[2*i+1];
+    j++;
+  }
+  poly->npts = j;
+}
+
+guint traceContour (hkVidLayout *vl, guint *rect, hkPolygon *poly)
+/* follow the outer border of the object in rect, clockwise */
+/* store a simplified outline in poly, return number of vertices */
+{
+  gint x = -1, y, sx, sy, bx, by, sbx, sby;
+  guint steps = 0, limit = 4 * (vl->width + 2) * (vl->height + 2);
+  poly->npts = 0;
+  // start at the first matching pixel along the top of the rect
+  for (y=rect[1]; y<=(gint)rect[3] && y<(gint)vl->height && x<0; y++){
+    const guint8 *row = vl->mask[MASK_ANY] + y * vl->mstride;
+    for (gint px=rect[0]; px<=(gint)rect[2] && px<(gint)vl->width; px++){
+      if ((row[px >> 3] >> (px & 7)) & 1){
+        x = px;
+        break;
+      }
+    }
+  }
+  if (x < 0) return 0;
+  y--;
+  // back up to the start of its run, so the pixel west is background
+  while (setAt (vl, x - 1, y)) x--;
+  sx = x, sy = y, sbx = bx = x - 1, sby = by = y;
+  do {
+    gint d = neighbor (bx - x, by - y), c = d, i;
+    addPoint (poly, x, y);
+    // sweep clockwise from the background pixel to the next border pixel
+    for (i=0; i<8; i++){
+      c = (c + 1) & 7;
+      if (setAt (vl, x + ndx[c], y + ndy[c])) break;
+      bx = x + ndx[c], by = y + ndy[c];
+    }
+    if (i == 8) break; // a lone pixel
+    x += ndx[c], y += ndy[c];
+  } while ((x != sx || y != sy || bx != sbx || by != sby) && ++steps < limit);
+  // straighten pixel staircases
+  simplify (poly, 1.0);
+  return poly->npts;
+}
+
+void polygonFree (hkPolygon *poly)
+{
+  g_free (poly->pt);
+  g_free (poly->keep);
+  g_free (poly->span);
+  memset (poly, 0, sizeof *poly);
+}
+
+void pyramidInit (hkPyramid *py, hkVidLayout *vl, guint level)
+/* (re)allocate a coarse frame 2^level times smaller than vl per side */
+/* call once per caps change, after layoutInit; level 0 turns it off */
+{
+  hkVidLayout *c = &py->vl;
+  guint ws = vl->wshift[1], hs = vl->hshift[1], size = 0;
+  pyramidFree (py);
+  // keep whole chroma samples, so the coarse frame subsamples like vl
+  c->space = vl->space;
+  c->width = vl->width >> (level + ws) << ws;
+  c->height = vl->height >> (level + hs) << hs;
+  if (!level || !c->width || !c->height) return;
+  py->level = level;
+  for (int k=3;k--;){
+    c->pwidth[k] = k ? c->width >> ws : c->width;
+    c->pheight[k] = k ? c->height >> hs : c->height;
+    c->wshift[k] = k ? ws : 0, c->hshift[k] = k ? hs : 0;
+    c->stride[k] = c->pwidth[k], c->pstride[k] = 1;
+    c->offset[k] = size;
+    size += c->stride[k] * c->pheight[k];
+  }
+  c->size = size;
+  py->buf = g_malloc (size);
+  for (int k=3;k--;)
+    c->data[k] = py->buf + c->offset[k];
+  layoutInit (c);
+  maskInit (c);
+}
+
+void pyramidMatch (hkVidLayout *vl, hkPyramid *py, guint **known, guint n,
+  hkPool *pool)
+/* match vl coarse to fine: match and label the coarse frame, then match */
+/* vl only around coarse blobs that start an object or touch a known */
+/* object's rect, widening each area until no blob crosses its edge */
+{
+  hkVidLayout *c = &py->vl;
+  guint s = 1 << py->level, r[4];
+  downsample (vl, c, py->level);
+  c->color0 = vl->color0, c->color1 = vl->color1, c->color2 = vl->color2;
+  c->threshold = vl->threshold;
+  c->lut = vl->lut, c->seed = vl->seed;
+  matchMask (c, pool);
+  labelBlobs (c, &py->blobs, pool);
+  maskClear (vl);
+  for (guint b=0; b<py->blobs.nblobs; b++){
+    guint *cr = py->blobs.blob[b].rect;
+    gboolean keep = py->blobs.blob[b].seeds > 0;
+    // a coarse pixel of margin for edges the sampling stepped over,
+    // and whatever the coarse frame cut off at the right and bottom
+    r[0] = cr[0] ? (cr[0] - 1) * s : 0;
+    r[1] = cr[1] ? (cr[1] - 1) * s : 0;
+    r[2] = cr[2] + 1 < c->width ? (cr[2] + 2) * s - 1 : vl->width - 1;
+    r[3] = cr[3] + 1 < c->height ? (cr[3] + 2) * s - 1 : vl->height - 1;
+    for (guint i=0; i<n && !keep; i++)
+      keep = known[i][0] <= r[2] && known[i][2] >= r[0]
+        && known[i][1] <= r[3] && known[i][3] >= r[1];
+    if (!keep) continue;
+    // parts too thin to survive sampling may lead out of the box
+    matchGrow (vl, r, s);
+  }
+}
+
+void pyramidFree (hkPyramid *py)
+{
+  maskFree (&py->vl);
+  blobsFree (&py->blobs);
+  g_free (py->buf);
+  memset (py, 0, sizeof *py);
+}
+//}
@@ -0,0 +1,92 @@
+/* HKBlob
+ * Copyright (C) 2014 Henry Kroll, www.thenerdshow.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _HKBLOB_H_
+#define _HKBLOB_H_
+#include "hkmatch.h"
+
+typedef struct _hkRun
+{
+  // a horizontal run of matching pixels x0..x1 on row y
+  guint x0, x1, y;
+} hkRun;
+
+typedef struct _hkBlob
+{
+  guint rect[4];                /* bounding box x1,y1,x2,y2 */
+  guint area;                   /* number of matching pixels */
+  guint seeds;                  /* how many of them match color0 */
+  gdouble cx, cy;               /* centroid */
+  gdouble mxx, myy, mxy;        /* central second moments / area */
+  gdouble angle;                /* major axis, radians from x axis */
+  // raw sums, valid while labeling
+  guint64 sx, sy, sxx, syy, sxy;
+} hkBlob;
+
+typedef struct _hkBlobs
+{
+  hkRun *run;
+  guint nruns, maxruns;
+  guint *label;                 /* per run: parent, then blob index */
+  guint *rowstart;              /* first run of each row, height + 1 */
+  guint height;
+  hkBlob *blob;                 /* blobs in top-down, left-right order */
+  guint nblobs, maxblobs;
+  guint nseeded;                /* leading blobs blobsSeek filled */
+  hkRun *stack;                 /* flood fill work list */
+  guint maxstack;
+  // parallel labeling: each band's runs, and the rows of a band
+  struct _hkBlobs *band;
+  guint nbands, y0, y1;
+} hkBlobs;
+
+typedef struct _hkPolygon
+{
+  // closed outline, vertex i at pt[2*i], pt[2*i+1], clockwise on screen
+  guint *pt;
+  guint npts, maxpts;
+  guint8 *keep;                 /* simplification work space */
+  guint *span;
+} hkPolygon;
+
+typedef struct _hkPyramid
+{
+  // the frame 2^level times smaller on each side, for coarse detection
+  guint level;                  /* 0 = off */
+  hkVidLayout vl;               /* coarse frame and its masks */
+  guint8 *buf;                  /* coarse frame planes */
+  hkBlobs blobs;                /* coarse blobs */
+} hkPyramid;
+
+void labelBlobs (hkVidLayout *vl, hkBlobs *lb, hkPool *pool);
+gboolean fillBlob (hkVidLayout *vl, hkBlobs *lb, guint x, guint y,
+  hkBlob *blob);
+gboolean seekBlob (hkVidLayout *vl, hkBlobs *lb, guint *rect,
+  guint *center, hkBlob *blob);
+void blobsSeek (hkVidLayout *vl, hkBlobs *lb, guint **known, guint n);
+guint blobDegrees (hkBlob *blob);
+void blobsFree (hkBlobs *lb);
+guint traceContour (hkVidLayout *vl, guint *rect, hkPolygon *poly);
+void polygonFree (hkPolygon *poly);
+void pyramidInit (hkPyramid *py, hkVidLayout *vl, guint level);
+void pyramidMatch (hkVidLayout *vl, hkPyramid *py, guint **known, guint n,
+  hkPool *pool);
+void pyramidFree (hkPyramid *py);
+
+#endif
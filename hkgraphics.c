@@ -18,7 +18,14 @@
  */
 //{
 #include "hkgraphics.h"
+#include "hkmatch.h"
 #include "gsttrack.h"
+#include "gsthkeffectsorc.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HK_X86 1
+#include <immintrin.h>
+#endif
 
 guint8* rgb2yuv (guint rgb, guint8 *yuv)
 /* convert from rgbint, store in supplied yuv array (pointer) */
@@ -36,14 +43,246 @@ guint8* rgb2yuv (guint rgb, guint8 *yuv)
   return yuv;
 }
 
+guint8* rgb2space (guint rgb, guint space, guint8 *color)
+/* convert from rgbint to a color in space, see hkVidLayout */
+{
+  if (space == SPACE_RGB){
+    for (int k=3; k--;) color[k] = rgb >> (16 - 8 * k);
+    return color;
+  }
+  rgb2yuv(rgb, color);
+  // gray frames read neutral chroma, so only luma can tell colors apart
+  if (space == SPACE_GRAY) color[1] = color[2] = 128;
+  return color;
+}
+
+void layoutInit(hkVidLayout *vl)
+/* derive per-plane scale factors from cached subsampling shifts */
+/* call once per caps change, after width, height, wshift, hshift */
+{
+  // from the format, not plane sizes, which round up for odd sizes
+  for (int k=3;k--;){
+    vl->wscale[k] = 1u << vl->wshift[k];
+    vl->hscale[k] = 1u << vl->hshift[k];
+  }
+  vl->clip[0] = 0, vl->clip[1] = vl->height - 1;
+}
+
+void scratchInit(hkVidLayout *vl)
+/* (re)allocate vl->scratch for the current frame size */
+/* call once per caps change, after layoutInit */
+{
+  // one row of 32 bit sums, then 40 bits per luma pixel: edge() keeps
+  // a byte per pixel beside a 32 bit work list
+  g_free(vl->scratch);
+  vl->scratch = g_malloc(vl->width * 4 + vl->width * vl->height * 5);
+}
+
+void scratchFree(hkVidLayout *vl)
+{
+  g_free(vl->scratch);
+  vl->scratch = NULL;
+}
+
+void plateInit(hkVidLayout *vl)
+/* (re)allocate an empty clean plate for cloak */
+/* call once per caps change, after layoutInit and maskInit */
+{
+  gsize size = 0;
+  for (int k=3; k--;) size += vl->pwidth[k] * vl->pheight[k];
+  g_free(vl->plate[0]);
+  vl->plate[0] = g_malloc(size + vl->mstride * vl->height);
+  vl->plate[1] = vl->plate[0] + vl->pwidth[0] * vl->pheight[0];
+  vl->plate[2] = vl->plate[1] + vl->pwidth[1] * vl->pheight[1];
+  vl->plated = vl->plate[2] + vl->pwidth[2] * vl->pheight[2];
+  memset(vl->plated, 0, vl->mstride * vl->height);
+}
+
+void plateFree(hkVidLayout *vl)
+{
+  g_free(vl->plate[0]);
+  vl->plate[0] = vl->plate[1] = vl->plate[2] = vl->plated = NULL;
+}
+
+static void plateMark(guint8 *row, guint x0, guint x1)
+/* note that the plate holds luma pixels x0..x1-1 of row */
+{
+  for (; x0 < x1 && (x0 & 7); x0++) row[x0 >> 3] |= 1 << (x0 & 7);
+  for (; x0 + 8 <= x1; x0 += 8) row[x0 >> 3] = 0xff;
+  for (; x0 < x1; x0++) row[x0 >> 3] |= 1 << (x0 & 7);
+}
+
+static gboolean plateHas(hkVidLayout *vl, guint x0, guint x1, guint y)
+/* whether the plate holds luma pixels x0..x1 of row y */
+{
+  const guint8 *row = vl->plated + y * vl->mstride;
+  for (; x0 <= x1 && (x0 & 7); x0++)
+    if (!(row[x0 >> 3] >> (x0 & 7) & 1)) return FALSE;
+  for (; x0 + 7 <= x1; x0 += 8)
+    if (row[x0 >> 3] != 0xff) return FALSE;
+  for (; x0 <= x1; x0++)
+    if (!(row[x0 >> 3] >> (x0 & 7) & 1)) return FALSE;
+  return TRUE;
+}
+
+void plateUpdate(hkVidLayout *vl, guint **rects, guint n, guint margin)
+/* copy vl->clip rows of this frame into the clean plate, */
+/* except inside n rects grown by margin */
+{
+  guint *span = g_newa(guint, 2 * n), r[4], p[4];
+  for (int k=layoutPlanes(vl); k--;){
+    guint pw = vl->pwidth[k], hs = vl->hshift[k], ps = vl->pstride[k];
+    for (guint py=(vl->clip[0] + (1u << hs) - 1) >> hs;
+      py<=vl->clip[1] >> hs; py++){
+      guint8 *row = planeRow(vl, k, py), *plate = vl->plate[k] + py * pw;
+      guint ns = 0, x = 0;
+      // rects covering this row, sorted by left edge
+      for (guint i=0; i<n; i++){
+        guint j = ns;
+        r[0] = rects[i][0] > margin ? rects[i][0] - margin : 0;
+        r[1] = rects[i][1] > margin ? rects[i][1] - margin : 0;
+        r[2] = MIN(rects[i][2] + margin, vl->width - 1);
+        r[3] = MIN(rects[i][3] + margin, vl->height - 1);
+        planeRect(vl, k, r, p);
+        if (py < p[1] || py > p[3]) continue;
+        for (; j && span[2*j-2] > p[0]; j--)
+          span[2*j] = span[2*j-2], span[2*j+1] = span[2*j-1];
+        span[2*j] = p[0], span[2*j+1] = p[2] + 1;
+        ns++;
+      }
+      // copy the gaps between them
+      for (guint i=0; i<=ns; i++){
+        guint end = i < ns ? span[2*i] : pw;
+        if (end > x){
+          copySamples(plate + x, 1, row + x * ps, ps, end - x);
+          if (!k) plateMark(vl->plated + py * vl->mstride, x, end);
+        }
+        if (i < ns) x = MAX(x, span[2*i+1]);
+      }
+    }
+  }
+}
+
 guint8 *getPixel(hkVidLayout *vl, int x, int y, guint8 layer)
 /* returns pixel data location at x, y, layer */
 /* caution: no bounds checking */
 {
-  guint8 *pixel;
-  pixel = vl->data[layer] + y/vl->hscale[layer] * vl->stride[layer]
-    + x/vl->wscale[layer];
-  return pixel;
+  return vl->data[layer] + (y >> vl->hshift[layer]) * vl->stride[layer]
+    + (x >> vl->wshift[layer]) * vl->pstride[layer];
+}
+
+guint8 *planeRow(hkVidLayout *vl, guint k, guint py)
+/* returns start of row py of plane k, in plane coordinates */
+/* sample px of the row is at px * vl->pstride[k] */
+{
+  return vl->data[k] + py * vl->stride[k];
+}
+
+typedef void (*hkGatherFunc) (guint8 *dst, const guint8 *src, guint n,
+  guint sps);
+
+static void gatherScalar (guint8 *dst, const guint8 *src, guint n,
+  guint sps)
+/* copy n samples, sps bytes apart, to consecutive bytes of dst */
+{
+  for (guint i=0; i<n; i++) dst[i] = src[i * sps];
+}
+
+#ifdef HK_X86
+__attribute__ ((target ("sse2")))
+static void gatherSse2 (guint8 *dst, const guint8 *src, guint n,
+  guint sps)
+/* gatherScalar for the 2 and 4 byte steps of packed and semi-planar */
+/* YUV: mask off the other samples, then pack the words down to bytes */
+{
+  guint i = 0;
+  // never read past the last sample, which may end the buffer
+  if (sps == 2){
+    const __m128i lo = _mm_set1_epi16 (0xff);
+    for (; i + 17 <= n; i += 16){
+      __m128i a = _mm_loadu_si128 ((const __m128i *) (src + 2 * i)),
+        b = _mm_loadu_si128 ((const __m128i *) (src + 2 * i + 16));
+      _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16
+          (_mm_and_si128 (a, lo), _mm_and_si128 (b, lo)));
+    }
+  } else if (sps == 4){
+    const __m128i lo = _mm_set1_epi32 (0xff);
+    for (; i + 17 <= n; i += 16){
+      const __m128i *p = (const __m128i *) (src + 4 * i);
+      __m128i a = _mm_and_si128 (_mm_loadu_si128 (p), lo),
+        b = _mm_and_si128 (_mm_loadu_si128 (p + 1), lo),
+        c = _mm_and_si128 (_mm_loadu_si128 (p + 2), lo),
+        d = _mm_and_si128 (_mm_loadu_si128 (p + 3), lo);
+      _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16
+          (_mm_packs_epi32 (a, b), _mm_packs_epi32 (c, d)));
+    }
+  }
+  gatherScalar (dst + i, src + i * sps, n - i, sps);
+}
+#endif
+
+static hkGatherFunc gather = gatherScalar;
+
+void copySamples(guint8 *dst, guint dps, const guint8 *src, guint sps,
+  guint n)
+/* copy n samples from src, sps bytes apart, to dst, dps bytes apart */
+{
+  if (dps == 1 && sps == 1) hk_orc_copy_u8(dst, src, n);
+  else if (dps == 1) gather(dst, src, n, sps);
+  else for (guint i=0; i<n; i++) dst[i * dps] = src[i * sps];
+}
+
+static void setSamples(guint8 *dst, guint ps, guint8 c, guint n)
+/* set n samples, ps bytes apart, to c */
+{
+  if (ps == 1) memset(dst, c, n);
+  else for (guint i=0; i<n; i++) dst[i * ps] = c;
+}
+
+void planeRect(hkVidLayout *vl, guint k, guint *rect, guint *prect)
+/* scale rect from luma coordinates to plane k coordinates */
+{
+  prect[0] = rect[0] >> vl->wshift[k];
+  prect[1] = rect[1] >> vl->hshift[k];
+  prect[2] = MIN(rect[2] >> vl->wshift[k], vl->pwidth[k] - 1);
+  prect[3] = MIN(rect[3] >> vl->hshift[k], vl->pheight[k] - 1);
+}
+
+static gboolean clipRect(hkVidLayout *vl, guint k, guint *rect, guint *prect)
+/* planeRect, keeping only plane rows whose first luma row is in */
+/* vl->clip, so bands never share a row; FALSE if no rows are left */
+{
+  guint hs = vl->hshift[k];
+  planeRect(vl, k, rect, prect);
+  prect[1] = MAX(prect[1], (vl->clip[0] + (1u << hs) - 1) >> hs);
+  prect[3] = MIN(prect[3], vl->clip[1] >> hs);
+  return prect[1] <= prect[3];
+}
+
+void fillRect(hkVidLayout *vl, guint *rect, guint8 *color)
+/* fill rect (inclusive) with color, one 2D store per plane */
+{
+  guint p[4];
+  if (rect[0] > rect[2] || rect[1] > rect[3]) return;
+  for (int k=layoutPlanes(vl);k--;){
+    guint ps = vl->pstride[k];
+    if (!clipRect(vl, k, rect, p)) continue;
+    if (ps == 1)
+      hk_orc_splat_u8_2d(planeRow(vl, k, p[1]) + p[0], vl->stride[k],
+        color[k], p[2] - p[0] + 1, p[3] - p[1] + 1);
+    else for (guint py=p[1]; py<=p[3]; py++)
+      setSamples(planeRow(vl, k, py) + p[0] * ps, ps, color[k],
+        p[2] - p[0] + 1);
+  }
+}
+
+static inline gboolean matchYUV (hkVidLayout *vl, guint8 y, guint8 u,
+  guint8 v, guint8 *color)
+/* check color against one Y, U, V (or R, G, B) sample and vl->threshold */
+{
+  const guint8 *w = spaceWeights(vl->space);
+  return w[0] * abs(y - color[0]) + w[1] * abs(u - color[1])
+    + w[2] * abs(v - color[2]) < vl->threshold;
 }
 
 void plotXY (hkVidLayout *vl, int x, int y, guint8 *color)
@@ -51,7 +290,7 @@ void plotXY (hkVidLayout *vl, int x, int y, guint8 *color)
 /* caution: no bounds checking */
 {
   guint8 *pixel;
-  for (int k=3;k--;){
+  for (int k=layoutPlanes(vl);k--;){
     pixel = getPixel(vl, x, y, k);
     *pixel = color[k];
   }
@@ -60,52 +299,66 @@ void plotXY (hkVidLayout *vl, int x, int y, guint8 *color)
 void crosshairs(hkVidLayout *vl, guint *point, guint8 *color)
 /* draw crosshairs at point with color */
 {
-  guint x=point[0], y=point[1];
-  // left crosshair
-  for (int i=x-4; i>0 && i > x-14 ;i--){
-    plotXY(vl, i, y, color);
+  gint x=point[0], y=point[1], w=vl->width, h=vl->height;
+  guint r[4];
+  // left, right crosshairs
+  r[1] = r[3] = y;
+  if (x > 4){
+    r[0] = MAX(x-13, 1), r[2] = x-4;
+    fillRect(vl, r, color);
   }
-  // right crosshair
-  for (int i=x+4; i<vl->width && i < x+14 ;i++){
-    plotXY(vl, i, y, color);
+  if (x+4 < w){
+    r[0] = x+4, r[2] = MIN(x+13, w-1);
+    fillRect(vl, r, color);
   }
-  // top crosshair
-  for (int i=y-4; i>0 && i > y-14 ;i--){
-    plotXY(vl, x, i, color);
+  // top, bottom crosshairs
+  r[0] = r[2] = x;
+  if (y > 4){
+    r[1] = MAX(y-13, 1), r[3] = y-4;
+    fillRect(vl, r, color);
   }
-  // bottom crosshair
-  for (int i=y+4; i<vl->height && i < y+14 ;i++){
-    plotXY(vl, x, i, color);
+  if (y+4 < h){
+    r[1] = y+4, r[3] = MIN(y+13, h-1);
+    fillRect(vl, r, color);
   }
 }
 
 void cloak(hkVidLayout *vl, guint *rect)
 /* attempt to cloak rect from video */
+/* rows the clean plate has seen come from the plate, see plateUpdate */
 {
-  guint8 *fromleft, *fromright, skip=0;
   guint width = rect[2]-rect[0], w2 = width / 2 + 1,
-        height = rect[3]-rect[1];
-  if (rect[0]<w2 || rect[2] > vl->width - w2) skip=1;
-  for(int y=rect[3]; y > rect[1] ; y--){
-    for(int x=w2; x--;){
-      for (int k=3; k--;){
-        if (skip) {
-          if (y > height){
-            fromright = getPixel(vl, rect[2] - x, y-height, k);
-            fromleft = getPixel(vl, rect[0] + x, y-height, k);
-          } else if (y < vl->height - height) {
-            fromright = getPixel(vl, rect[2] - x, y+height, k);
-            fromleft = getPixel(vl, rect[0] + x, y+height, k);
-          } else {
-            fromright = getPixel(vl, rect[2] - x, y, k);
-            fromleft = getPixel(vl, rect[0] + x, y, k);
-          }
-        } else {
-          fromright = getPixel(vl, rect[2] + x, y, k);
-          fromleft = getPixel(vl, rect[0] - x, y, k);
+        height = rect[3]-rect[1], p[4];
+  gboolean skip = rect[0]<w2 || rect[2] > vl->width - w2;
+  for (int k=layoutPlanes(vl); k--;){
+    guint hs = vl->hshift[k], ph = height >> hs, ps = vl->pstride[k];
+    gint pw2 = MAX(w2 >> vl->wshift[k], 1), pw = vl->pwidth[k];
+    guint8 *row, *src;
+    if (!clipRect(vl, k, rect, p)) continue;
+    for (guint py=p[1]; py<=p[3]; py++){
+      row = src = planeRow(vl, k, py);
+      if (vl->plate[0] && plateHas(vl, rect[0], rect[2], py << hs)){
+        copySamples(row + p[0] * ps, ps, vl->plate[k] + py * pw + p[0], 1,
+          p[2] - p[0] + 1);
+        continue;
+      }
+      if (skip) {
+        // too close to the edge to mirror; borrow rows above or below
+        if ((py << hs) > height)
+          src = planeRow(vl, k, py - ph);
+        else if ((py << hs) < vl->height - height)
+          src = planeRow(vl, k, py + ph);
+        if (src == row) continue;
+        copySamples(row + p[0] * ps, ps, src + p[0] * ps, ps,
+          MIN(pw2, pw - p[0]));
+        copySamples(row + (p[2] + 1 - MIN(pw2, p[2] + 1)) * ps, ps,
+          src + (p[2] + 1 - MIN(pw2, p[2] + 1)) * ps, ps, MIN(pw2, p[2] + 1));
+      } else {
+        // mirror neighboring columns into the rect
+        for (gint x=0; x<pw2; x++){
+          row[(p[2] - x) * ps] = row[MIN(p[2] + x, pw - 1) * ps];
+          row[(p[0] + x) * ps] = row[MAX((gint)p[0] - x, 0) * ps];
         }
-        *(getPixel(vl, rect[2] - x, y, k)) = *fromright;
-        *(getPixel(vl, rect[0] + x, y, k)) = *fromleft;
       }
     }
   }
@@ -113,109 +366,281 @@ void cloak(hkVidLayout *vl, guint *rect)
 
 void blur(hkVidLayout *vl, guint *rect, guint8 sz)
 /* blur rect sz x sz average */
+/* sliding sums, so cost per pixel does not depend on sz */
 {
-  guint t, s=sz/2, u=s/2;
-  guint8 *p;
-  for(int y=rect[3]; y > rect[1]; y--){
-    if (y < s || y >= vl->height - s) break;
-    for(int x=rect[2]; x > rect[0]; x--){
-      if (x < s || x >= vl->width - s) break;
-      for(int k=3;k--;){
-        t  = *(getPixel(vl, x-s, y-s, k));
-        t += *(getPixel(vl, x+s, y-s, k));
-        t += *(getPixel(vl, x-s, y+s, k));
-        t += *(getPixel(vl, x+s, y+s, k));
-        t += *(getPixel(vl, x-u, y, k));
-        t += *(getPixel(vl, x+u, y, k));
-        t += *(getPixel(vl, x, y-u, k));
-        t += *(getPixel(vl, x, y+u, k));
-        p = getPixel(vl, x, y, k);
-        *p = t>>3;
+  guint p[4];
+  if (rect[0] > rect[2] || rect[1] > rect[3]) return;
+  for (int k=layoutPlanes(vl); k--;){
+    gint rx = (sz/2) >> vl->wshift[k], ry = (sz/2) >> vl->hshift[k],
+      pw = vl->pwidth[k], ph = vl->pheight[k], ps = vl->pstride[k], w, y0, y1;
+    guint32 *vsum = (guint32 *) vl->scratch;
+    guint16 *hsum;
+    guint64 recip;
+    planeRect(vl, k, rect, p);
+    w = p[2] - p[0] + 1;
+    hsum = (guint16 *) (vsum + w);
+    // horizontal sums of every row the window touches, into scratch;
+    // samples past the plane edge repeat the edge pixel
+    y0 = MAX((gint)p[1] - ry, 0), y1 = MIN((gint)p[3] + ry + 1, ph - 1);
+    for (gint py=y0; py<=y1; py++){
+      guint8 *src = planeRow(vl, k, py);
+      guint16 *out = hsum + (py - y0) * w;
+      guint s = 0;
+      for (gint i=-rx; i<=rx; i++)
+        s += src[CLAMP((gint)p[0] + i, 0, pw - 1) * ps];
+      for (gint px=p[0]; px<=(gint)p[2]; px++){
+        out[px - p[0]] = s;
+        s += src[MIN(px + rx + 1, pw - 1) * ps] - src[MAX(px - rx, 0) * ps];
+      }
+    }
+    // vertical sums slide down the rect, writing back to the plane
+    recip = (G_GUINT64_CONSTANT (1) << 32) / ((2*rx + 1) * (2*ry + 1));
+    memset(vsum, 0, w * sizeof *vsum);
+    for (gint i=-ry; i<=ry; i++){
+      guint16 *in = hsum + (CLAMP((gint)p[1] + i, 0, ph - 1) - y0) * w;
+      for (gint x=0; x<w; x++) vsum[x] += in[x];
+    }
+    for (gint py=p[1]; py<=(gint)p[3]; py++){
+      guint8 *row = planeRow(vl, k, py) + p[0] * ps;
+      guint16 *add = hsum + (MIN(py + ry + 1, ph - 1) - y0) * w,
+        *sub = hsum + (MAX(py - ry, 0) - y0) * w;
+      for (gint x=0; x<w; x++){
+        row[x * ps] = (vsum[x] * recip + (1u << 31)) >> 32;
+        vsum[x] += add[x] - sub[x];
       }
     }
   }
 }
 
-void outline(hkVidLayout *vl, guint *rect, guint8 *color)
-/* draw edges to color */
-{
-  #define LIM 5000
-  gboolean plot, match;
-  gint xa[LIM + 1], ya[LIM + 1], i=0,
-    xs = rect[2] + 2, ys = rect[3] + 2,
-    xe = rect[0] - 2, ye = rect[1] - 2;
-  if (xs >= vl->width) xs = vl->width - 1;
-  if (ys >= vl->height)ys = vl->height - 1;
-  if (ye < 0) ye = 0;
-  if (xe < 0) xe = 0;
-  for(int y=ys; y > ye; y--){
-    plot = FALSE;
-    for(int x=xs; x > xe; x-=2){
-      match = matchAny(vl, x, y);
-      if (match != plot || match != matchAny(vl, x, y - 1))
-        xa[i]=x, ya[i++]=y;
-      if (i == LIM) break;
-      plot = match;
-    } if (i == LIM) break;
+void line(hkVidLayout *vl, gint x0, gint y0, gint x1, gint y1,
+  guint8 *color)
+/* draw a line from x0,y0 to x1,y1 with color */
+/* caution: no bounds checking */
+{
+  // Bresenham, one plotted pixel per step
+  gint dx = abs(x1 - x0), dy = -abs(y1 - y0),
+    sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1, err = dx + dy;
+  while (1){
+    gint e2 = 2 * err;
+    plotXY(vl, x0, y0, color);
+    if (x0 == x1 && y0 == y1) break;
+    // both tests use the error from before this step
+    if (e2 >= dy) err += dy, x0 += sx;
+    if (e2 <= dx) err += dx, y0 += sy;
+  }
+}
+
+void outline(hkVidLayout *vl, guint *pt, guint n, guint8 *color)
+/* draw closed polygon of n vertices x,y in pt[] with color */
+{
+  for (guint i=0; i<n; i++){
+    guint j = (i + 1) % n;
+    line(vl, pt[2*i], pt[2*i+1], pt[2*j], pt[2*j+1], color);
+  }
+}
+
+// Sobel magnitude |gx| + |gy| of strong and weak edge pixels
+#define EDGE_HIGH 56
+#define EDGE_LOW 28
+
+typedef void (*hkSobelRowFunc) (const guint8 *r0, const guint8 *r1,
+  const guint8 *r2, gint i, gint n, guint16 *mag, guint8 *dir);
+
+static inline guint8 sobelDir (gint gx, gint gy)
+/* quantize gradient direction: 0 along x, 1 along y, 2 and 3 diagonal */
+{
+  gint ax = abs(gx), ay = abs(gy);
+  if (5 * ay < 2 * ax) return 0;
+  if (2 * ay > 5 * ax) return 1;
+  return (gx ^ gy) >= 0 ? 2 : 3;
+}
+
+static void sobelRowScalar (const guint8 *r0, const guint8 *r1,
+  const guint8 *r2, gint i, gint n, guint16 *mag, guint8 *dir)
+/* gradient of pixels i..n-1 of row r1; r0 is above, r2 below */
+/* caution: reads one pixel before and after the span */
+{
+  for (; i < n; i++){
+    gint gx = r0[i+1] + 2 * r1[i+1] + r2[i+1] - r0[i-1] - 2 * r1[i-1] - r2[i-1],
+      gy = r2[i-1] + 2 * r2[i] + r2[i+1] - r0[i-1] - 2 * r0[i] - r0[i+1];
+    mag[i] = abs(gx) + abs(gy);
+    dir[i] = sobelDir(gx, gy);
+  }
+}
+
+#ifdef HK_X86
+__attribute__ ((target ("sse2")))
+static inline __m128i load8Sse2 (const guint8 *p)
+/* 8 pixels widened to words */
+{
+  return _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) p),
+      _mm_setzero_si128 ());
+}
+
+__attribute__ ((target ("sse2")))
+static void sobelRowSse2 (const guint8 *r0, const guint8 *r1,
+  const guint8 *r2, gint i, gint n, guint16 *mag, guint8 *dir)
+{
+  const __m128i zero = _mm_setzero_si128 (), one = _mm_set1_epi16 (1),
+    three = _mm_set1_epi16 (3), none = _mm_set1_epi16 (-1);
+  for (; i + 8 <= n; i += 8){
+    __m128i a0 = load8Sse2 (r0 + i - 1), b0 = load8Sse2 (r0 + i),
+      c0 = load8Sse2 (r0 + i + 1), a1 = load8Sse2 (r1 + i - 1),
+      c1 = load8Sse2 (r1 + i + 1), a2 = load8Sse2 (r2 + i - 1),
+      b2 = load8Sse2 (r2 + i), c2 = load8Sse2 (r2 + i + 1);
+    __m128i gx, gy, ax, ay, t, d;
+    gx = _mm_sub_epi16 (_mm_add_epi16 (_mm_add_epi16 (c0, c2),
+          _mm_add_epi16 (c1, c1)), _mm_add_epi16 (_mm_add_epi16 (a0, a2),
+          _mm_add_epi16 (a1, a1)));
+    gy = _mm_sub_epi16 (_mm_add_epi16 (_mm_add_epi16 (a2, c2),
+          _mm_add_epi16 (b2, b2)), _mm_add_epi16 (_mm_add_epi16 (a0, c0),
+          _mm_add_epi16 (b0, b0)));
+    ax = _mm_max_epi16 (gx, _mm_sub_epi16 (zero, gx));
+    ay = _mm_max_epi16 (gy, _mm_sub_epi16 (zero, gy));
+    _mm_storeu_si128 ((__m128i *) (mag + i), _mm_add_epi16 (ax, ay));
+    // same steps as sobelDir: diagonal, then along y, then along x
+    d = _mm_add_epi16 (three,
+        _mm_cmpgt_epi16 (_mm_xor_si128 (gx, gy), none));
+    t = _mm_cmpgt_epi16 (_mm_add_epi16 (ay, ay),
+        _mm_add_epi16 (_mm_slli_epi16 (ax, 2), ax));
+    d = _mm_or_si128 (_mm_and_si128 (t, one), _mm_andnot_si128 (t, d));
+    t = _mm_cmplt_epi16 (_mm_add_epi16 (_mm_slli_epi16 (ay, 2), ay),
+        _mm_add_epi16 (ax, ax));
+    d = _mm_andnot_si128 (t, d);
+    _mm_storel_epi64 ((__m128i *) (dir + i), _mm_packus_epi16 (d, zero));
+  }
+  sobelRowScalar (r0, r1, r2, i, n, mag, dir);
+}
+#endif
+
+static hkSobelRowFunc sobelRow = sobelRowScalar;
+
+void graphicsInit (void)
+/* pick the fastest row kernels this CPU supports; call at plugin load */
+{
+#ifdef HK_X86
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("sse2")){
+    sobelRow = sobelRowSse2;
+    gather = gatherSse2;
   }
-  while(i--){ 
-    plotXY(vl,xa[i],ya[i],color);
-    plotXY(vl,xa[i]-1,ya[i],color);
+#endif
+}
+
+void edge(hkVidLayout *vl, guint *rect, guint8 *color, gboolean thin)
+/* edge detection around rect, marked with color */
+/* thin: keep only the ridge of each edge, as Canny does */
+{
+  static const gint dx[4] = {1, 0, 1, -1}, dy[4] = {0, 1, 1, 1};
+  gint x0 = MAX((gint)rect[0] - 4, 1), y0 = MAX((gint)rect[1] - 4, 1),
+    x1 = MIN((gint)rect[2] + 4, (gint)vl->width - 2),
+    y1 = MIN((gint)rect[3] + 4, (gint)vl->height - 2),
+    w = x1 - x0 + 1, h = y1 - y0 + 1, n = 0,
+    // green carries most of the luma of RGB
+    l = vl->space == SPACE_RGB ? 1 : 0, ps = vl->pstride[l];
+  guint8 *out = vl->scratch, *dir, *rows;
+  guint16 *mag;
+  guint32 *stack;
+  if (w < 1 || h < 1) return;
+  // a byte of result per pixel, then the gradients, 32 bit aligned
+  mag = (guint16 *) (out + ((w * h + 3) & ~3)), dir = (guint8 *) (mag + w * h);
+  rows = ps == 1 ? NULL : g_newa(guint8, 3 * (w + 2));
+  // gradients go to scratch, so marks never feed back into the result
+  for (gint y=y0; y<=y1; y++){
+    const guint8 *r1 = planeRow(vl, l, y) + x0 * ps,
+      *r[3] = {r1 - vl->stride[l], r1, r1 + vl->stride[l]};
+    // packed luma: unpack the rows first, with a pixel either side
+    for (int j=3; rows && j--;){
+      copySamples(rows + j * (w + 2), 1, r[j] - ps, ps, w + 2);
+      r[j] = rows + j * (w + 2) + 1;
+    }
+    sobelRow(r[0], r[1], r[2], 0, w, mag + (y - y0) * w, dir + (y - y0) * w);
   }
-  #undef LIM
-}
-
-void edge(hkVidLayout *vl, guint *rect, guint8 *color)
-/* edge detection */
-{
-  gint v, t, k=0, xs = rect[2] + 4, ys = rect[3] + 4,
-    xe = rect[0] - 4, ye = rect[1] - 4, diff;
-  gboolean mark = FALSE, trail = FALSE;
-  if (xs >= vl->width) xs = vl->width - 2;
-  if (ys >= vl->height)ys = vl->height - 2;
-  if (ye < 1) ye = 1;
-  if (xe < 1) xe = 1;
-  for(int y=ys; y > ye; y--){
-    for(int x=xs; x > xe; x--){
-      t = v = 0;
-      //vertical
-      for(int i=3;i--;){
-        t += *(getPixel(vl, x-1, y-i, k));
-        v += *(getPixel(vl, x-2, y-i, k));
+  // 2 strong, 1 weak, 0 none
+  for (gint y=0, i=0; y<h; y++){
+    for (gint x=0; x<w; x++, i++){
+      guint m = mag[i];
+      if (thin && m >= EDGE_LOW){
+        // not a ridge if a neighbor across the edge is stronger
+        gint d = dir[i], xa = x + dx[d], ya = y + dy[d],
+          xb = x - dx[d], yb = y - dy[d];
+        if ((xa >= 0 && xa < w && ya < h && mag[ya * w + xa] > m)
+          || (xb >= 0 && xb < w && yb >= 0 && mag[yb * w + xb] >= m))
+          m = 0;
       }
-      diff = abs(t - v), mark = FALSE;
-      if (diff > 20 && trail) mark = TRUE;
-      if (diff > 40) mark = TRUE;
-      t = v = 0;
-      //horizontal
-      for(int i=3;i--;){
-        t += *(getPixel(vl, x-i, y-1, k));
-        v += *(getPixel(vl, x-i, y-2, k));
+      out[i] = m >= EDGE_HIGH ? 2 : m >= EDGE_LOW;
+    }
+  }
+  // hysteresis: weak pixels joined to strong ones become strong (3);
+  // gradients are done with, so their space holds the work list,
+  // where each pixel goes at most once
+  stack = (guint32 *) mag;
+  for (gint i=0; i<w*h; i++){
+    if (out[i] != 2) continue;
+    out[i] = 3, stack[n++] = i;
+    while (n){
+      gint j = stack[--n], x = j % w, y = j / w;
+      for (gint ny=MAX(y - 1, 0); ny<=MIN(y + 1, h - 1); ny++){
+        for (gint nx=MAX(x - 1, 0); nx<=MIN(x + 1, w - 1); nx++){
+          gint k = ny * w + nx;
+          if (out[k] == 1 || out[k] == 2){
+            out[k] = 3;
+            stack[n++] = k;
+          }
+        }
       }
-      diff = abs(t - v);
-      if (diff > 20 && trail) mark = TRUE;
-      if (diff > 40) mark = TRUE;
-      if (mark) plotXY(vl, x, y, color);
-      trail = mark || *(getPixel(vl, x, y+1, k)) == color[0]
-        || *(getPixel(vl, x-1, y+1, k)) == color[0]
-        || *(getPixel(vl, x+1, y+1, k)) == color[0];
     }
   }
+  for (gint y=0, i=0; y<h; y++)
+    for (gint x=0; x<w; x++, i++)
+      if (out[i] == 3) plotXY(vl, x0 + x, y0 + y, color);
+}
+
+void downsample(hkVidLayout *vl, hkVidLayout *dst, guint level)
+/* copy the middle pixel of each 2^level x 2^level block of every */
+/* plane of vl to dst, whose plane sizes must already be set */
+{
+  guint s = 1 << level, mid = s >> 1;
+  for (int k=layoutPlanes(vl);k--;){
+    guint ps = vl->pstride[k];
+    for (guint py=0; py<dst->pheight[k]; py++)
+      copySamples(planeRow(dst, k, py), dst->pstride[k],
+        planeRow(vl, k, py * s + mid) + mid * ps, ps << level,
+        dst->pwidth[k]);
+  }
 }
 
 void decimate(hkVidLayout *vl, guint *rect, guint8 sz)
-/* blur rect sz x sz average */
+/* pixelate rect, filling sz x sz blocks with their average */
 {
-  guint k=0;
-  for(int y=rect[3] - sz; y > rect[1]; y-=sz){
-    if (y<0 || y > vl->height - sz) break;
-    for(int x=rect[2] - sz; x > rect[0]; x-=sz){
-      if (x<0 || x>vl->width - sz) break;
-      for (int yy=sz;yy--;){
-        for (int xx=sz;xx--;){
-          *(getPixel(vl, x+xx, y+yy, k)) = *(getPixel(vl, x, y, k));
+  guint p[4];
+  if (!sz || rect[0] > rect[2] || rect[1] > rect[3]) return;
+  for (int k=layoutPlanes(vl); k--;){
+    guint bw = MAX(sz >> vl->wshift[k], 1), bh = MAX(sz >> vl->hshift[k], 1),
+      ps = vl->pstride[k];
+    guint32 *sum = (guint32 *) vl->scratch;
+    planeRect(vl, k, rect, p);
+    // blocks start at the rect corner; edge blocks are cut short
+    for (guint y0=p[1]; y0<=p[3]; y0+=bh){
+      guint y1 = MIN(y0 + bh - 1, p[3]);
+      memset(sum, 0, ((p[2] - p[0]) / bw + 1) * sizeof *sum);
+      for (guint py=y0; py<=y1; py++){
+        guint8 *row = planeRow(vl, k, py);
+        for (guint x0=p[0], b=0; x0<=p[2]; x0+=bw, b++){
+          guint x1 = MIN(x0 + bw - 1, p[2]), s = 0;
+          for (guint px=x0; px<=x1; px++) s += row[px * ps];
+          sum[b] += s;
         }
       }
+      for (guint x0=p[0], b=0; x0<=p[2]; x0+=bw, b++){
+        guint n = (MIN(x0 + bw - 1, p[2]) - x0 + 1) * (y1 - y0 + 1);
+        sum[b] = (sum[b] + n / 2) / n;
+      }
+      for (guint py=y0; py<=y1; py++){
+        guint8 *row = planeRow(vl, k, py);
+        for (guint x0=p[0], b=0; x0<=p[2]; x0+=bw, b++)
+          setSamples(row + x0 * ps, ps, sum[b], MIN(bw, p[2] - x0 + 1));
+      }
     }
   }
 }
@@ -223,30 +648,28 @@ void decimate(hkVidLayout *vl, guint *rect, guint8 sz)
 void box(hkVidLayout *vl, guint *rect, guint8 *color)
 /* draw box at rect[4] with color */
 {
-  guint x1 = rect[0], y1 = rect[1], x2 = rect[2], y2 = rect[3];
-  // box top
-  for (int i=x2;i>x1;i--){
-    plotXY(vl, i, y1, color);
-  }
-  // box bottom
-  for (int i=x2;i>x1;i--){
-    plotXY(vl, i, y2, color);
-  }
-  // box left
-  for (int i=y2;i>y1;i--){
-    plotXY(vl, x1, i, color);
-  }
-  // box right
-  for (int i=y2;i>y1;i--){
-    plotXY(vl, x2, i, color);
-  }
+  guint x1 = rect[0], y1 = rect[1], x2 = rect[2], y2 = rect[3],
+    line[4];
+  // box top, bottom
+  line[0] = x1, line[2] = x2;
+  line[1] = line[3] = y1;
+  fillRect(vl, line, color);
+  line[1] = line[3] = y2;
+  fillRect(vl, line, color);
+  // box left, right
+  line[1] = y1, line[3] = y2;
+  line[0] = line[2] = x1;
+  fillRect(vl, line, color);
+  line[0] = line[2] = x2;
+  fillRect(vl, line, color);
 }
 
 guint8* colorAt (hkVidLayout *vl, int x, int y, guint8 *color)
 /* copy color at x,y into supplied array (pointer) */
 {
   guint8 *pixel;
-  for (int k=3;k--;){
+  color[1] = color[2] = 128;
+  for (int k=layoutPlanes(vl);k--;){
     pixel = getPixel(vl, x, y, k);
     color[k] = *pixel;
   }
@@ -258,19 +681,17 @@ guint8* colorAt (hkVidLayout *vl, int x, int y, guint8 *color)
 gboolean matchColor (hkVidLayout *vl, int x, int y, guint8 *color)
 /* check if supplied color matches color at x,y and vl->threshold */
 {
-  guint8 *pixel;
-  guint diff = 0;
-  for (int k=3;k--;){
-    pixel = getPixel(vl, x, y, k);
-    // k+1 favors color over shade
-    diff += (k+1) * abs(*pixel - color[k]);
-  }
-  return diff < vl->threshold;
+  guint8 c[3];
+  colorAt(vl, x, y, c);
+  return matchYUV(vl, c[0], c[1], c[2], color);
 }
 
 gboolean matchAny (hkVidLayout *vl, int x, int y)
 /* check if any color matches that at x,y and vl->threshold */
 {
+  // read this frame's match mask if matchMask() made one
+  if (vl->mask[MASK_ANY])
+    return maskAt(vl, MASK_ANY, x, y);
   return matchColor(vl, x, y, vl->color0) || 
         matchColor(vl, x, y, vl->color1) ||
         matchColor(vl, x, y, vl->color2);
@@ -278,19 +699,34 @@ gboolean matchAny (hkVidLayout *vl, int x, int y)
 
 void colorize(hkVidLayout *vl, guint *rect, guint8* color)
 /* colorize rect to color */
+/* YUV keeps each pixel's shade; RGB has none apart, and gray no color */
 {
-  for(int y=rect[3]; y > rect[1]; y--){
-    for(int x=rect[2]; x > rect[0]; x--){
-      if (matchAny(vl, x, y)) for (int k=2; k>0;k--)
-        *(getPixel(vl, x, y, k)) = color[k];
+  // walk the chroma planes at their own resolution; each chroma
+  // sample is tested against the luma sample sited at its corner
+  guint p[4], ws = vl->wshift[1], hs = vl->hshift[1], n,
+    k0 = vl->space == SPACE_RGB ? 0 : 1;
+  guint8 *m = vl->scratch;
+  if (vl->space == SPACE_GRAY || rect[0] > rect[2] || rect[1] > rect[3]
+    || !clipRect(vl, 1, rect, p)) return;
+  n = p[2] - p[0] + 1;
+  for (guint py=p[1]; py<=p[3]; py++){
+    // one byte of mask per sample, then a masked store per plane row
+    for (guint i=0; i<n; i++)
+      m[i] = matchAny(vl, (p[0] + i) << ws, py << hs) ? 0xff : 0;
+    for (guint k=k0; k<3; k++){
+      guint ps = vl->pstride[k];
+      guint8 *row = planeRow(vl, k, py) + p[0] * ps;
+      if (ps == 1) hk_orc_colorize_u8(row, m, color[k], n);
+      else for (guint i=0; i<n; i++) if (m[i]) row[i * ps] = color[k];
     }
   }
 }
 
-guint* getLength(hkVidLayout *vl, int x, int y, int dx, int dy)
+guint* getLength(hkVidLayout *vl, int x, int y, int dx, int dy,
+  guint *endpoint)
 /* stretch the measuring tape across a color patch */
+/* store the far end in supplied array (pointer) */
 {
-  static guint endpoint[2];
   while (1) {
     x += dx, y += dy;
     if ( x < 0 
@@ -315,7 +751,7 @@ guint* getBounds(hkVidLayout *vl, int x, int y, guint *rect)
 {
   #define STEP 8
   gboolean expanded;
-  guint *extent;
+  guint extent[2];
   if (y >= 0 && y < vl->height && x >= 0 && x < vl->width){
     if (!rect[3]) {
       rect[0] = rect[2] = x;
@@ -326,7 +762,7 @@ guint* getBounds(hkVidLayout *vl, int x, int y, guint *rect)
       expanded = FALSE;
       // right
       for (int v = rect[1]; v<=rect[3]; v+=1){
-        extent = getLength(vl, rect[2], v, STEP, 0);
+        getLength(vl, rect[2], v, STEP, 0, extent);
         if (extent[0] > rect[2]){
           rect[2] = extent[0];
           expanded = TRUE;
@@ -334,7 +770,7 @@ guint* getBounds(hkVidLayout *vl, int x, int y, guint *rect)
       }
       // down
       for (int h = rect[0]; h<=rect[2]; h+=1){
-        extent = getLength(vl, h, rect[3], 0, STEP);
+        getLength(vl, h, rect[3], 0, STEP, extent);
         if (extent[1] > rect[3]){
           rect[3] = extent[1];
           expanded = TRUE;
@@ -342,7 +778,7 @@ guint* getBounds(hkVidLayout *vl, int x, int y, guint *rect)
       }
       // left
       for (int v = rect[1]; v<=rect[3]; v+=1){
-        extent = getLength(vl, rect[0], v, -STEP, 0);
+        getLength(vl, rect[0], v, -STEP, 0, extent);
         if (extent[0] < rect[0]){
           rect[0] = extent[0];
           expanded = TRUE;
@@ -350,7 +786,7 @@ guint* getBounds(hkVidLayout *vl, int x, int y, guint *rect)
       }
       // up
       for (int h = rect[0]; h<=rect[2]; h+=1){
-        extent = getLength(vl, h, rect[1], 0, -STEP);
+        getLength(vl, h, rect[1], 0, -STEP, extent);
         if (extent[1] < rect[1]){
           rect[1] = extent[1];
           expanded = TRUE;
@@ -361,10 +797,9 @@ guint* getBounds(hkVidLayout *vl, int x, int y, guint *rect)
   return rect;
 }
 
-guint *rectCenter(guint *rect)
-/* return center of rect */
+guint *rectCenter(guint *rect, guint *point)
+/* store center of rect in supplied array (pointer) */
 {
-  static guint point[2];
   point[0] = (rect[0] + rect[2]) / 2;
   point[1] = (rect[1] + rect[3]) / 2;
   return point;
@@ -22,36 +22,91 @@
 // if not using gst.h #include glib-2.0/glib.h
 #include <gst/gst.h>
 
+// color spaces of hkVidLayout, and of colors meant for it
+#define SPACE_YUV 0
+#define SPACE_RGB 1
+#define SPACE_GRAY 2            /* luma only; planes 1 and 2 are absent */
+
 typedef struct _hkVidLayout
 {
-  // 3 data areas (YUV or RGB)
+  // 3 data areas (YUV or RGB), which packed formats interleave;
+  // pstride is the distance in bytes from one sample to the next
+  guint space;
   guint8 *data[3];
-  guint stride[3], wscale[3], hscale[3];
+  guint stride[3], pstride[3], wscale[3], hscale[3];
   guint width, height, size;
+  // native plane geometry and subsampling, cached once per caps change
+  guint offset[3], pwidth[3], pheight[3], wshift[3], hshift[3];
   // tracking colors for getLength, getDiff, getBounds
   guint8 *color0;
   guint8 *color1;
   guint8 *color2;
   guint threshold;
-  // todo: use this struct to reduce number of func args
+  gboolean chroma;              // match once per chroma sample
+  // match masks for color0 and any color, visited bits, see hkmatch.h
+  guint8 *mask[3];
+  guint mstride;
+  // optional YUV class table for extra colors and teams, see hkmatch.h
+  guint8 *lut, *seed;
+  guint8 *classes;              // per pixel class ids, width x height
+  // work area for marks that must not read their own output
+  guint8 *scratch;
+  // clean plate background for cloak, and which luma pixels it holds
+  guint8 *plate[3], *plated;
+  // luma rows y0..y1 this call may change, e.g. one band of the frame
+  guint clip[2];
+  // one copy per frame or band; results go to caller arrays, never
+  // to static storage, so instances and bands may run concurrently
 } hkVidLayout;
 
+static inline guint layoutPlanes (hkVidLayout *vl)
+/* number of planes holding samples */
+{
+  return vl->space == SPACE_GRAY ? 1 : 3;
+}
+
+static inline const guint8 *spaceWeights (guint space)
+/* weights of the 3 channel differences when matching a color */
+{
+  // YUV favors color over shade; RGB weighs its channels alike, with
+  // the same total so a threshold means about as much in either space
+  static const guint8 w[3][3] = {{1, 2, 3}, {2, 2, 2}, {1, 2, 3}};
+  return w[space];
+}
+
+void graphicsInit (void);
 guint8* rgb2yuv (guint rgb, guint8 *yuv);
+guint8* rgb2space (guint rgb, guint space, guint8 *color);
+void layoutInit(hkVidLayout *vl);
+void scratchInit(hkVidLayout *vl);
+void scratchFree(hkVidLayout *vl);
+void plateInit(hkVidLayout *vl);
+void plateFree(hkVidLayout *vl);
+void plateUpdate(hkVidLayout *vl, guint **rects, guint n, guint margin);
 guint8 *getPixel(hkVidLayout *vl, int x, int y, guint8 layer);
+guint8 *planeRow(hkVidLayout *vl, guint k, guint py);
+void copySamples(guint8 *dst, guint dps, const guint8 *src, guint sps,
+  guint n);
+void planeRect(hkVidLayout *vl, guint k, guint *rect, guint *prect);
+void fillRect(hkVidLayout *vl, guint *rect, guint8 *color);
 void plotXY (hkVidLayout *vl, int x, int y, guint8 *color);
 void crosshairs(hkVidLayout *vl, guint *point, guint8 *color);
 void cloak(hkVidLayout *vl, guint *rect);
+void downsample(hkVidLayout *vl, hkVidLayout *dst, guint level);
 void decimate(hkVidLayout *vl, guint *rect, guint8 sz);
 void colorize(hkVidLayout *vl, guint *rect, guint8* color);
 void blur(hkVidLayout *vl, guint *rect, guint8 sz);
-void edge(hkVidLayout *vl, guint *rect, guint8 *color);
-void outline(hkVidLayout *vl, guint *rect, guint8 *color);
+void edge(hkVidLayout *vl, guint *rect, guint8 *color, gboolean thin);
+void line(hkVidLayout *vl, gint x0, gint y0, gint x1, gint y1,
+  guint8 *color);
+void outline(hkVidLayout *vl, guint *pt, guint n, guint8 *color);
 void box(hkVidLayout *vl, guint *rect, guint8 *color);
 guint8* colorAt (hkVidLayout *vl, int x, int y, guint8 *color);
 gboolean matchColor (hkVidLayout *vl, int x, int y, guint8 *color);
 gboolean matchAny (hkVidLayout *vl, int x, int y);
-guint* getLength(hkVidLayout *vl, int x, int y, int dx, int dy);
+guint* getLength(hkVidLayout *vl, int x, int y, int dx, int dy,
+  guint *endpoint);
 guint* getBounds(hkVidLayout *vl, int x, int y, guint *rect);
-guint *rectCenter(guint *rect);
+guint *rectCenter(guint *rect, guint *point);
 
 #endif
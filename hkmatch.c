@@ -0,0 +1,660 @@
+/* HKMatch
+ * Copyright (C) 2014 Henry Kroll, www.thenerdshow.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+/* Whole-frame color matching. Each frame is compared against the
+ * tracking colors once, producing bit masks that getLength, getBounds,
+ * outline, colorize and friends read instead of re-matching pixels.
+ * The row kernel is chosen once at plugin load from the CPU features.
+ * When more than three colors, or Y:U:V box regions, are configured,
+ * pixels are instead classified by one lookup in a quantized YUV table
+ * that is only rebuilt when the colors or threshold change. The table
+ * also labels each pixel with its class for telling teams apart.
+ * Subsampled frames may instead be matched once per chroma sample,
+ * with the luma pixel at its top-left, and the matches widened back
+ * to every luma pixel the sample covers.
+ * Packed and semi-planar frames (YUY2, AYUV, NV12 and the like) have
+ * each span's samples unpacked into plain rows first, so the same row
+ * kernels serve every layout. RGB frames are matched as they are, in
+ * RGB, against colors converted to RGB; gray frames against neutral
+ * chroma, so only luma counts.
+ */
+//{
+#include <stdio.h>
+#include <string.h>
+#include "hkmatch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HK_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct _hkMatchRow
+{
+  const guint8 *y, *u, *v;      /* source rows */
+  guint width, wshift;          /* luma width, chroma subsampling */
+  guint8 *color[3];             /* tracking colors */
+  const guint8 *weight;         /* channel weights, see spaceWeights */
+  guint threshold;
+  const guint8 *lut, *seed;     /* YUV class table, seed classes */
+  guint8 *m0, *many;            /* destination mask rows */
+  guint8 *classes;              /* destination class row, optional */
+  guint8 *unpack;               /* 3 rows for packed samples, or NULL */
+} hkMatchRow;
+
+typedef void (*hkMatchRowFunc) (hkMatchRow *r, guint x);
+
+static void matchRowScalar (hkMatchRow *r, guint x)
+/* match pixels x..width, x must be a multiple of 8 */
+{
+  guint8 b0 = 0, bany = 0;
+  for (; x < r->width; x++){
+    guint c = x >> r->wshift, bit = x & 7;
+    gint y = r->y[x], u = r->u[c], v = r->v[c];
+    const guint8 *w = r->weight;
+    for (int i=3; i--;){
+      guint8 *col = r->color[i];
+      if (w[0] * abs(y - col[0]) + w[1] * abs(u - col[1])
+          + w[2] * abs(v - col[2]) < r->threshold){
+        bany |= 1 << bit;
+        if (!i) b0 |= 1 << bit;
+      }
+    }
+    if (bit == 7){
+      r->m0[x >> 3] = b0, r->many[x >> 3] = bany;
+      b0 = bany = 0;
+    }
+  }
+  if (x & 7){
+    r->m0[x >> 3] = b0, r->many[x >> 3] = bany;
+  }
+}
+
+static void matchRowLut (hkMatchRow *r, guint x)
+/* classify pixels x..width by table lookup */
+{
+  guint8 b0 = 0, bany = 0, c;
+  for (; x < r->width; x++){
+    guint cx = x >> r->wshift, bit = x & 7;
+    c = r->lut[LUT_INDEX(r->y[x], r->u[cx], r->v[cx])];
+    if (r->classes) r->classes[x] = c;
+    if (c) bany |= 1 << bit;
+    if (r->seed[c]) b0 |= 1 << bit;
+    if (bit == 7){
+      r->m0[x >> 3] = b0, r->many[x >> 3] = bany;
+      b0 = bany = 0;
+    }
+  }
+  if (x & 7){
+    r->m0[x >> 3] = b0, r->many[x >> 3] = bany;
+  }
+}
+
+#ifdef HK_X86
+__attribute__ ((target ("sse2")))
+static inline __m128i chroma16Sse2 (const guint8 *c, guint x, guint wshift)
+/* load 16 chroma samples for luma x..x+15, duplicated to luma width */
+{
+  __m128i t;
+  guint32 q;
+  switch (wshift){
+    case 0:
+      return _mm_loadu_si128 ((const __m128i *) (c + x));
+    case 1:
+      t = _mm_loadl_epi64 ((const __m128i *) (c + (x >> 1)));
+      return _mm_unpacklo_epi8 (t, t);
+    default:
+      memcpy (&q, c + (x >> 2), 4);
+      t = _mm_cvtsi32_si128 (q);
+      t = _mm_unpacklo_epi8 (t, t);
+      return _mm_unpacklo_epi8 (t, t);
+  }
+}
+
+__attribute__ ((target ("sse2")))
+static void matchRowSse2 (hkMatchRow *r, guint x)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i thr = _mm_set1_epi16 (r->threshold);
+  const __m128i wy = _mm_set1_epi16 (r->weight[0]),
+    wu = _mm_set1_epi16 (r->weight[1]), wv = _mm_set1_epi16 (r->weight[2]);
+  __m128i cy[3], cu[3], cv[3];
+  for (int i=3; i--;){
+    cy[i] = _mm_set1_epi8 (r->color[i][0]);
+    cu[i] = _mm_set1_epi8 (r->color[i][1]);
+    cv[i] = _mm_set1_epi8 (r->color[i][2]);
+  }
+  for (; x + 16 <= r->width; x += 16){
+    __m128i y = _mm_loadu_si128 ((const __m128i *) (r->y + x));
+    __m128i u = chroma16Sse2 (r->u, x, r->wshift);
+    __m128i v = chroma16Sse2 (r->v, x, r->wshift);
+    guint m[3];
+    for (int i=3; i--;){
+      // |a-b| on bytes, then weighted sums on words
+      __m128i dy = _mm_or_si128 (_mm_subs_epu8 (y, cy[i]),
+          _mm_subs_epu8 (cy[i], y));
+      __m128i du = _mm_or_si128 (_mm_subs_epu8 (u, cu[i]),
+          _mm_subs_epu8 (cu[i], u));
+      __m128i dv = _mm_or_si128 (_mm_subs_epu8 (v, cv[i]),
+          _mm_subs_epu8 (cv[i], v));
+      __m128i lo, hi;
+      lo = _mm_add_epi16 (_mm_add_epi16
+          (_mm_mullo_epi16 (_mm_unpacklo_epi8 (dy, zero), wy),
+          _mm_mullo_epi16 (_mm_unpacklo_epi8 (du, zero), wu)),
+          _mm_mullo_epi16 (_mm_unpacklo_epi8 (dv, zero), wv));
+      hi = _mm_add_epi16 (_mm_add_epi16
+          (_mm_mullo_epi16 (_mm_unpackhi_epi8 (dy, zero), wy),
+          _mm_mullo_epi16 (_mm_unpackhi_epi8 (du, zero), wu)),
+          _mm_mullo_epi16 (_mm_unpackhi_epi8 (dv, zero), wv));
+      m[i] = _mm_movemask_epi8 (_mm_packs_epi16 (_mm_cmplt_epi16 (lo, thr),
+              _mm_cmplt_epi16 (hi, thr)));
+    }
+    *(guint16 *) (r->m0 + (x >> 3)) = m[0];
+    *(guint16 *) (r->many + (x >> 3)) = m[0] | m[1] | m[2];
+  }
+  matchRowScalar (r, x);
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i chroma32Avx2 (const guint8 *c, guint x, guint wshift)
+/* load 32 chroma samples for luma x..x+31, duplicated to luma width */
+{
+  __m128i t;
+  switch (wshift){
+    case 0:
+      return _mm256_loadu_si256 ((const __m256i *) (c + x));
+    case 1:
+      t = _mm_loadu_si128 ((const __m128i *) (c + (x >> 1)));
+      return _mm256_set_m128i (_mm_unpackhi_epi8 (t, t),
+          _mm_unpacklo_epi8 (t, t));
+    default:
+      t = _mm_loadl_epi64 ((const __m128i *) (c + (x >> 2)));
+      t = _mm_unpacklo_epi8 (t, t);
+      return _mm256_set_m128i (_mm_unpackhi_epi8 (t, t),
+          _mm_unpacklo_epi8 (t, t));
+  }
+}
+
+__attribute__ ((target ("avx2")))
+static void matchRowAvx2 (hkMatchRow *r, guint x)
+{
+  const __m256i thr = _mm256_set1_epi16 (r->threshold);
+  const __m256i wy = _mm256_set1_epi16 (r->weight[0]),
+    wu = _mm256_set1_epi16 (r->weight[1]),
+    wv = _mm256_set1_epi16 (r->weight[2]);
+  __m256i cy[3], cu[3], cv[3];
+  for (int i=3; i--;){
+    cy[i] = _mm256_set1_epi8 (r->color[i][0]);
+    cu[i] = _mm256_set1_epi8 (r->color[i][1]);
+    cv[i] = _mm256_set1_epi8 (r->color[i][2]);
+  }
+  for (; x + 32 <= r->width; x += 32){
+    __m256i y = _mm256_loadu_si256 ((const __m256i *) (r->y + x));
+    __m256i u = chroma32Avx2 (r->u, x, r->wshift);
+    __m256i v = chroma32Avx2 (r->v, x, r->wshift);
+    guint32 m[3];
+    for (int i=3; i--;){
+      __m256i dy = _mm256_or_si256 (_mm256_subs_epu8 (y, cy[i]),
+          _mm256_subs_epu8 (cy[i], y));
+      __m256i du = _mm256_or_si256 (_mm256_subs_epu8 (u, cu[i]),
+          _mm256_subs_epu8 (cu[i], u));
+      __m256i dv = _mm256_or_si256 (_mm256_subs_epu8 (v, cv[i]),
+          _mm256_subs_epu8 (cv[i], v));
+      __m256i lo, hi, t;
+      // widen each 128-bit half so pixel order survives the pack
+      lo = _mm256_add_epi16 (_mm256_add_epi16 (_mm256_mullo_epi16
+          (_mm256_cvtepu8_epi16 (_mm256_castsi256_si128 (dy)), wy),
+          _mm256_mullo_epi16
+          (_mm256_cvtepu8_epi16 (_mm256_castsi256_si128 (du)), wu)),
+          _mm256_mullo_epi16
+          (_mm256_cvtepu8_epi16 (_mm256_castsi256_si128 (dv)), wv));
+      hi = _mm256_add_epi16 (_mm256_add_epi16 (_mm256_mullo_epi16
+          (_mm256_cvtepu8_epi16 (_mm256_extracti128_si256 (dy, 1)), wy),
+          _mm256_mullo_epi16
+          (_mm256_cvtepu8_epi16 (_mm256_extracti128_si256 (du, 1)), wu)),
+          _mm256_mullo_epi16
+          (_mm256_cvtepu8_epi16 (_mm256_extracti128_si256 (dv, 1)), wv));
+      t = _mm256_packs_epi16 (_mm256_cmpgt_epi16 (thr, lo),
+          _mm256_cmpgt_epi16 (thr, hi));
+      m[i] = _mm256_movemask_epi8 (_mm256_permute4x64_epi64 (t, 0xd8));
+    }
+    *(guint32 *) (r->m0 + (x >> 3)) = m[0];
+    *(guint32 *) (r->many + (x >> 3)) = m[0] | m[1] | m[2];
+  }
+  matchRowSse2 (r, x);
+}
+#endif
+
+static hkMatchRowFunc matchRow = matchRowScalar;
+static guint16 spread2[256];    /* each bit of a byte, twice */
+
+void matchInit (void)
+/* pick the fastest row kernel this CPU supports; call at plugin load */
+{
+  for (guint b=0; b<256; b++){
+    spread2[b] = 0;
+    for (guint i=0; i<8; i++)
+      if (b >> i & 1) spread2[b] |= 3 << (2 * i);
+  }
+#ifdef HK_X86
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2")){
+    matchRow = matchRowAvx2;
+  } else if (__builtin_cpu_supports ("sse2")){
+    matchRow = matchRowSse2;
+  }
+#endif
+}
+
+void maskInit (hkVidLayout *vl)
+/* (re)allocate match masks for vl->width x vl->height */
+/* call once per caps change, after layoutInit */
+{
+  // pad rows to 64 bits so scans can work a word at a time
+  vl->mstride = (vl->width + 63) / 64 * 8;
+  g_free (vl->mask[0]);
+  vl->mask[0] = g_malloc0 (3 * vl->mstride * vl->height);
+  vl->mask[1] = vl->mask[0] + vl->mstride * vl->height;
+  vl->mask[2] = vl->mask[1] + vl->mstride * vl->height;
+  // class ids are only needed for teams, see classesInit
+  g_free (vl->classes);
+  vl->classes = NULL;
+}
+
+void classesInit (hkVidLayout *vl)
+/* allocate per pixel class ids, if not done since maskInit */
+{
+  if (!vl->classes) vl->classes = g_malloc0 (vl->width * vl->height);
+}
+
+void maskFree (hkVidLayout *vl)
+{
+  g_free (vl->mask[0]);
+  g_free (vl->classes);
+  vl->mask[0] = vl->mask[1] = vl->mask[2] = vl->classes = NULL;
+}
+
+static gboolean isPacked (hkVidLayout *vl)
+/* whether any plane's samples are not next to each other, or, for */
+/* gray frames, chroma must be made up; either way rows are unpacked */
+{
+  return vl->space == SPACE_GRAY
+    || (vl->pstride[0] | vl->pstride[1] | vl->pstride[2]) != 1;
+}
+
+static void unpackSetup (hkVidLayout *vl, hkMatchRow *r, guint8 *rows)
+/* give r 3 rows of vl->width to unpack into, or none if not packed; */
+/* gray frames have neutral chroma there */
+{
+  r->unpack = isPacked (vl) ? rows : NULL;
+  if (vl->space == SPACE_GRAY) memset (rows + vl->width, 128, vl->width);
+}
+
+static void matchSetup (hkVidLayout *vl, hkMatchRow *r)
+/* fill in the parts of r that stay the same for every row */
+/* r->unpack is left to the caller, which must allocate it */
+{
+  r->color[0] = vl->color0, r->color[1] = vl->color1;
+  r->color[2] = vl->color2;
+  r->threshold = vl->threshold;
+  r->lut = vl->lut, r->seed = vl->seed;
+  r->wshift = vl->wshift[1];
+  r->weight = spaceWeights (vl->space);
+}
+
+static void matchSpan (hkVidLayout *vl, hkMatchRow *r, guint y, guint x0,
+  guint x1)
+/* match pixels x0..x1 of row y; x0 and x1 + 1 multiples of 8, or x1 */
+/* the last pixel of the row */
+{
+  guint cx = x0 >> vl->wshift[1], *ps = vl->pstride;
+  r->width = x1 - x0 + 1;
+  r->y = planeRow(vl, 0, y) + x0 * ps[0];
+  r->u = planeRow(vl, 1, y >> vl->hshift[1]) + cx * ps[1];
+  r->v = planeRow(vl, 2, y >> vl->hshift[2]) + cx * ps[2];
+  if (vl->space == SPACE_GRAY){
+    r->u = r->v = r->unpack + vl->width;
+  } else if (r->unpack){
+    guint cn = (x1 >> vl->wshift[1]) - cx + 1;
+    copySamples (r->unpack, 1, r->y, ps[0], r->width);
+    copySamples (r->unpack + vl->width, 1, r->u, ps[1], cn);
+    copySamples (r->unpack + 2 * vl->width, 1, r->v, ps[2], cn);
+    r->y = r->unpack, r->u = r->unpack + vl->width;
+    r->v = r->unpack + 2 * vl->width;
+  }
+  r->m0 = vl->mask[MASK_COLOR0] + y * vl->mstride + (x0 >> 3);
+  r->many = vl->mask[MASK_ANY] + y * vl->mstride + (x0 >> 3);
+  r->classes = vl->classes ? vl->classes + y * vl->width + x0 : NULL;
+  if (r->lut) matchRowLut (r, 0);
+  else matchRow (r, 0);
+}
+
+static void matchBand (gpointer data, guint band, guint y0, guint y1)
+/* match rows y0..y1 */
+{
+  hkVidLayout *vl = data;
+  hkMatchRow r;
+  matchSetup (vl, &r);
+  unpackSetup (vl, &r, g_newa (guint8, 3 * vl->width));
+  for (guint y=y0; y<=y1; y++){
+    // nothing is visited yet in a new frame
+    memset (vl->mask[MASK_VISITED] + y * vl->mstride, 0, vl->mstride);
+    matchSpan (vl, &r, y, 0, vl->width - 1);
+  }
+}
+
+static void widenRow (const guint8 *src, guint8 *dst, guint n,
+  guint shift)
+/* repeat each bit of n bytes of src 2^shift times into dst */
+{
+  guint16 w, lo, hi;
+  for (guint i=0; i<n; i++){
+    w = spread2[src[i]];
+    switch (shift){
+      case 0:
+        dst[i] = src[i];
+        break;
+      case 1:
+        dst[2 * i] = w, dst[2 * i + 1] = w >> 8;
+        break;
+      default:
+        lo = spread2[w & 0xff], hi = spread2[w >> 8];
+        dst[4 * i] = lo, dst[4 * i + 1] = lo >> 8;
+        dst[4 * i + 2] = hi, dst[4 * i + 3] = hi >> 8;
+        break;
+    }
+  }
+}
+
+static void maskRow (hkVidLayout *vl, guint m, guint y, const guint8 *src)
+/* copy width bits of src to row y of mask m, clearing the padding */
+{
+  guint8 *row = vl->mask[m] + y * vl->mstride;
+  guint n = (vl->width + 7) >> 3;
+  memcpy (row, src, n);
+  if (vl->width & 7) row[n - 1] &= (1 << (vl->width & 7)) - 1;
+  memset (row + n, 0, vl->mstride - n);
+}
+
+static void matchChromaBand (gpointer data, guint band, guint y0, guint y1)
+/* match rows y0..y1 at chroma resolution */
+{
+  hkVidLayout *vl = data;
+  guint ws = vl->wshift[1], hs = vl->hshift[1], cw = vl->pwidth[1],
+    cn = (cw + 7) >> 3, *ps = vl->pstride;
+  guint8 *luma = g_newa (guint8, cw), *m0 = g_newa (guint8, cn),
+    *many = g_newa (guint8, cn), *w0 = g_newa (guint8, cn << ws),
+    *wany = g_newa (guint8, cn << ws);
+  hkMatchRow r;
+  matchSetup (vl, &r);
+  r.wshift = 0, r.width = cw;
+  r.y = luma, r.m0 = m0, r.many = many;
+  r.classes = vl->classes ? g_newa (guint8, cw) : NULL;
+  r.unpack = isPacked (vl) ? g_newa (guint8, 2 * cw) : NULL;
+  // chroma rows that start in this band; they may end in the next
+  for (guint cy=(y0 + (1 << hs) - 1) >> hs; cy << hs <= y1; cy++){
+    copySamples (luma, 1, planeRow(vl, 0, cy << hs), ps[0] << ws, cw);
+    r.u = planeRow(vl, 1, cy), r.v = planeRow(vl, 2, cy);
+    if (r.unpack){
+      copySamples (r.unpack, 1, r.u, ps[1], cw);
+      copySamples (r.unpack + cw, 1, r.v, ps[2], cw);
+      r.u = r.unpack, r.v = r.unpack + cw;
+    }
+    if (r.lut) matchRowLut (&r, 0);
+    else matchRow (&r, 0);
+    widenRow (m0, w0, cn, ws);
+    widenRow (many, wany, cn, ws);
+    for (guint y=cy << hs; y < MIN((cy + 1) << hs, vl->height); y++){
+      maskRow (vl, MASK_COLOR0, y, w0);
+      maskRow (vl, MASK_ANY, y, wany);
+      memset (vl->mask[MASK_VISITED] + y * vl->mstride, 0, vl->mstride);
+      if (r.classes){
+        guint8 *row = vl->classes + y * vl->width;
+        for (guint x=0; x<vl->width; x++) row[x] = r.classes[x >> ws];
+      }
+    }
+  }
+}
+
+void matchMask (hkVidLayout *vl, hkPool *pool)
+/* match every pixel in vl->clip rows against vl->color0, 1, 2 */
+/* in parallel bands when pool is not NULL */
+{
+  hkBandFunc fn = matchBand;
+  // one match per chroma sample, when asked and there is subsampling
+  if (vl->chroma && (vl->wshift[1] || vl->hshift[1]))
+    fn = matchChromaBand;
+  if (pool) poolRun (pool, fn, vl, vl->clip[0], vl->clip[1]);
+  else fn (vl, 0, vl->clip[0], vl->clip[1]);
+}
+
+void maskClear (hkVidLayout *vl)
+/* empty all masks in vl->clip rows, before matching only some rects */
+{
+  for (int m=3; m--;)
+    memset (vl->mask[m] + vl->clip[0] * vl->mstride, 0,
+      (vl->clip[1] - vl->clip[0] + 1) * vl->mstride);
+  // teamOf counts every pixel of a rect, matched or not
+  if (vl->classes)
+    memset (vl->classes + vl->clip[0] * vl->width, 0,
+      (vl->clip[1] - vl->clip[0] + 1) * vl->width);
+}
+
+static guint rectSpills (hkVidLayout *vl, guint *r)
+/* which sides of r have matching pixels on them: 1 left, 2 top, */
+/* 4 right, 8 bottom; the frame edges never spill */
+{
+  guint sides = 0;
+  for (guint y=r[1]; y<=r[3]; y++){
+    if (r[0] && maskAt(vl, MASK_ANY, r[0], y)) sides |= 1;
+    if (r[2] + 1 < vl->width && maskAt(vl, MASK_ANY, r[2], y)) sides |= 4;
+  }
+  for (guint x=r[0]; x<=r[2]; x++){
+    if (r[1] > vl->clip[0] && maskAt(vl, MASK_ANY, x, r[1])) sides |= 2;
+    if (r[3] < vl->clip[1] && maskAt(vl, MASK_ANY, x, r[3])) sides |= 8;
+  }
+  return sides;
+}
+
+void matchRect (hkVidLayout *vl, guint *rect)
+/* match the pixels in rect, widened to whole mask bytes, against */
+/* vl->color0, 1, 2; see maskClear */
+{
+  hkMatchRow r;
+  guint x0 = rect[0] & ~7, x1 = MIN(rect[2] | 7, vl->width - 1),
+    y0 = MAX(rect[1], vl->clip[0]), y1 = MIN(rect[3], vl->clip[1]);
+  if (rect[0] > rect[2]) return;
+  matchSetup (vl, &r);
+  unpackSetup (vl, &r, g_newa (guint8, 3 * vl->width));
+  for (guint y=y0; y<=y1; y++)
+    matchSpan (vl, &r, y, x0, x1);
+}
+
+guint colorsParse (const gchar *spec, hkColor *colors, guint max,
+  guint threshold, guint space)
+/* parse a list of extra colors into colors[] of space, return count */
+/* entries are separated by commas or spaces and may be */
+/*   0xRRGGBB        an RGB color matched within threshold */
+/*   0xRRGGBB/T      an RGB color with its own threshold T */
+/*   Y-Y:U-U:V-V     a box of YUV ranges, e.g. skin 0-255:77-127:133-173 */
+/*                   in any space; RGB pixels are converted to test it */
+{
+  gchar **tok;
+  guint n = 0, r[6];
+  if (!spec) return 0;
+  tok = g_strsplit_set (spec, ", ", -1);
+  for (gchar **t = tok; *t && n < max; t++){
+    gchar *end;
+    hkColor *c = &colors[n];
+    if (!**t) continue;
+    if (sscanf (*t, "%u-%u:%u-%u:%u-%u", r, r+1, r+2, r+3, r+4, r+5) == 6){
+      c->box = TRUE;
+      for (int k=3; k--;){
+        c->lo[k] = MIN(r[2*k], 255);
+        c->hi[k] = MIN(r[2*k+1], 255);
+      }
+      n++;
+      continue;
+    }
+    c->box = FALSE;
+    rgb2space (g_ascii_strtoull (*t, &end, 0), space, c->yuv);
+    if (end == *t) continue; // not a color; skip it
+    c->threshold = *end == '/' ? g_ascii_strtoull (end + 1, NULL, 0)
+      : threshold;
+    n++;
+  }
+  g_strfreev (tok);
+  return n;
+}
+
+static guint8 classify (hkColorTable *t, gint y, gint u, gint v)
+/* return 1 + index of the first color matching y,u,v, or 0 */
+{
+  const guint8 *w = spaceWeights (t->space);
+  for (guint i=0; i<t->ncolors; i++){
+    hkColor *c = &t->colors[i];
+    if (c->box){
+      guint8 p[3] = {y, u, v};
+      // boxes are YUV ranges, whatever the frames hold
+      if (t->space == SPACE_RGB) rgb2yuv (y << 16 | u << 8 | v, p);
+      if (p[0] >= c->lo[0] && p[0] <= c->hi[0] && p[1] >= c->lo[1]
+          && p[1] <= c->hi[1] && p[2] >= c->lo[2] && p[2] <= c->hi[2])
+        return i + 1;
+    } else if (w[0] * abs(y - c->yuv[0]) + w[1] * abs(u - c->yuv[1])
+        + w[2] * abs(v - c->yuv[2]) < c->threshold)
+      return i + 1;
+  }
+  return 0;
+}
+
+static guint8 tableAdd (hkColorTable *t, hkColor *c)
+/* add c to the color list, return its class id or 0 if full */
+{
+  for (guint i=0; i<t->ncolors; i++){
+    hkColor *o = &t->colors[i];
+    if (!c->box && !o->box && o->threshold == c->threshold
+        && !memcmp (o->yuv, c->yuv, 3))
+      return i + 1;
+  }
+  if (t->ncolors == MAX_COLORS) return 0;
+  t->colors[t->ncolors++] = *c;
+  return t->ncolors;
+}
+
+void tableSetup (hkColorTable *t, guint8 **yuv, guint threshold,
+  const gchar *spec, const gchar *teams, guint space)
+/* rebuild color list from 3 tracking colors, or from teams, */
+/* plus the optional extra colors in spec, all in space */
+/* teams are separated by semicolons, each "color0,color1,color2" */
+/* the class table is only built when the SIMD kernels can't cope */
+{
+  hkColor c[MAX_COLORS];
+  guint8 *cell;
+  guint n, q = 1 << LUT_BITS, half = 1 << LUT_SHIFT >> 1;
+  t->ncolors = t->nteams = 0;
+  t->space = space;
+  memset (t->seed, 0, sizeof t->seed);
+  memset (t->team, 0, sizeof t->team);
+  if (teams && *teams){
+    gchar **tok = g_strsplit_set (teams, ";", -1);
+    for (gchar **p = tok; *p && t->nteams < MAX_TEAMS; p++){
+      n = colorsParse (*p, c, 3, threshold, space);
+      if (!n) continue;
+      for (guint r=0; r<n; r++)
+        t->team[t->nteams][r] = tableAdd (t, &c[r]);
+      t->seed[t->team[t->nteams++][0]] = 1;
+    }
+    g_strfreev (tok);
+  } else {
+    for (int i=0; i<3; i++){
+      c[i].box = FALSE;
+      memcpy (c[i].yuv, yuv[i], 3);
+      c[i].threshold = threshold;
+      t->seed[tableAdd (t, &c[i])] |= !i;
+    }
+  }
+  t->seed[0] = 0;
+  n = colorsParse (spec, c, MAX_COLORS, threshold, space);
+  for (guint i=0; i<n; i++) tableAdd (t, &c[i]);
+  if (!n && !t->nteams){
+    tableFree (t);
+    return;
+  }
+  if (!t->lut) t->lut = g_malloc (q * q * q);
+  // classify each cell by its center
+  cell = t->lut;
+  for (guint y=0; y<q; y++)
+    for (guint u=0; u<q; u++)
+      for (guint v=0; v<q; v++)
+        *cell++ = classify (t, (y << LUT_SHIFT) + half,
+            (u << LUT_SHIFT) + half, (v << LUT_SHIFT) + half);
+}
+
+void tableFree (hkColorTable *t)
+{
+  g_free (t->lut);
+  t->lut = NULL;
+}
+
+gint teamOf (hkVidLayout *vl, hkColorTable *t, guint *rect)
+/* return the team of the object in rect, -1 if none qualifies */
+/* the team's color0 must be present and its color1, color2 confirm */
+{
+  guint count[MAX_COLORS + 1] = {0}, best = 0;
+  gint team = -1;
+  if (!t->nteams || !vl->classes) return 0;
+  for (guint y=rect[1]; y<=rect[3]; y++){
+    guint8 *row = vl->classes + y * vl->width;
+    for (guint x=rect[0]; x<=rect[2]; x++) count[row[x]]++;
+  }
+  for (guint i=0; i<t->nteams; i++){
+    guint8 *id = t->team[i];
+    if (!count[id[0]] || (id[1] && !count[id[1]])
+        || (id[2] && !count[id[2]]))
+      continue;
+    if (count[id[0]] > best) best = count[id[0]], team = i;
+  }
+  return team;
+}
+
+void matchGrow (hkVidLayout *vl, guint *r, guint step)
+/* match the pixels in r, then widen r and match what it gained while */
+/* matching pixels touch its edges, step pixels first, then twice that */
+{
+  matchRect (vl, r);
+  for (guint g=step, sides; (sides = rectSpills (vl, r)); g *= 2){
+    guint n[4] = {r[0], r[1], r[2], r[3]}, strip[4];
+    if (sides & 1) n[0] = r[0] > g ? r[0] - g : 0;
+    if (sides & 2) n[1] = r[1] > g ? r[1] - g : 0;
+    if (sides & 4) n[2] = MIN(r[2] + g, vl->width - 1);
+    if (sides & 8) n[3] = MIN(r[3] + g, vl->height - 1);
+    // match only what the box grew by: full height sides, then the
+    // top and bottom between them
+    strip[1] = n[1], strip[3] = n[3];
+    strip[0] = n[0], strip[2] = r[0] - 1;
+    if (n[0] < r[0]) matchRect (vl, strip);
+    strip[0] = r[2] + 1, strip[2] = n[2];
+    if (n[2] > r[2]) matchRect (vl, strip);
+    strip[0] = r[0], strip[2] = r[2];
+    strip[1] = n[1], strip[3] = r[1] - 1;
+    if (n[1] < r[1]) matchRect (vl, strip);
+    strip[1] = r[3] + 1, strip[3] = n[3];
+    if (n[3] > r[3]) matchRect (vl, strip);
+    memcpy (r, n, sizeof n);
+  }
+}
+//}
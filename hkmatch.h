@@ -0,0 +1,84 @@
+/* HKMatch
+ * Copyright (C) 2014 Henry Kroll, www.thenerdshow.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _HKMATCH_H_
+#define _HKMATCH_H_
+#include "hkgraphics.h"
+#include "hkpool.h"
+
+// match masks: one bit per luma pixel, LSB is leftmost
+#define MASK_COLOR0 0           /* pixel matches color0 (of any team) */
+#define MASK_ANY 1              /* pixel matches any tracking color */
+#define MASK_VISITED 2          /* pixel already claimed by a blob */
+
+static inline gboolean maskAt (hkVidLayout *vl, guint m, int x, int y)
+/* read match mask m at x,y */
+/* caution: no bounds checking */
+{
+  return (vl->mask[m][y * vl->mstride + (x >> 3)] >> (x & 7)) & 1;
+}
+
+// YUV class table: LUT_BITS per channel, one class id per cell,
+// 0 = no match, n = first matching entry in the color list.
+// Identical colors share one entry, so teams may share markings.
+#define LUT_BITS 6
+#define LUT_SHIFT (8 - LUT_BITS)
+#define LUT_INDEX(y,u,v) ((((y) >> LUT_SHIFT) << (2 * LUT_BITS)) \
+  | (((u) >> LUT_SHIFT) << LUT_BITS) | ((v) >> LUT_SHIFT))
+#define MAX_COLORS 255
+#define MAX_TEAMS 32
+
+typedef struct _hkColor
+{
+  // a color with its own threshold, or a Y:U:V box such as skin tones,
+  // in the color space of the frames it is matched against
+  gboolean box;
+  guint8 yuv[3];
+  guint threshold;
+  guint8 lo[3], hi[3];
+} hkColor;
+
+typedef struct _hkColorTable
+{
+  hkColor colors[MAX_COLORS];
+  guint ncolors;
+  guint8 *lut;                  /* NULL while 3 plain colors will do */
+  guint8 seed[MAX_COLORS + 1];  /* class ids that start an object */
+  // team color0, color1, color2 as class ids, 0 if unused
+  guint8 team[MAX_TEAMS][3];
+  guint nteams;
+  guint space;                  /* color space of the entries */
+} hkColorTable;
+
+void matchInit (void);
+void maskInit (hkVidLayout *vl);
+void maskFree (hkVidLayout *vl);
+void matchMask (hkVidLayout *vl, hkPool *pool);
+void maskClear (hkVidLayout *vl);
+void matchRect (hkVidLayout *vl, guint *rect);
+void matchGrow (hkVidLayout *vl, guint *r, guint step);
+guint colorsParse (const gchar *spec, hkColor *colors, guint max,
+  guint threshold, guint space);
+void tableSetup (hkColorTable *t, guint8 **yuv, guint threshold,
+  const gchar *spec, const gchar *teams, guint space);
+void tableFree (hkColorTable *t);
+void classesInit (hkVidLayout *vl);
+gint teamOf (hkVidLayout *vl, hkColorTable *t, guint *rect);
+
+#endif
@@ -0,0 +1,253 @@
+/* HKObjects
+ * Copyright (C) 2014 Henry Kroll, www.thenerdshow.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+/* Tracked object store. Objects keep their id while tracked; the live
+ * list holds the ids in use, so per frame work is linear in the number
+ * of objects, and a uniform grid over the frame finds the objects near
+ * a rect without looking at the rest. Each analyzed frame, objectsAssign
+ * pairs the objects with the frame's blobs, cheapest pairing first, so
+ * crossing objects keep their own ids.
+ */
+//{
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hkobjects.h"
+
+static guint gridCell (hkObjects *os, guint x, guint y)
+/* grid cell holding x,y */
+{
+  x /= GRID_CELL, y /= GRID_CELL;
+  return MIN(y, os->gh - 1) * os->gw + MIN(x, os->gw - 1);
+}
+
+static void gridSpan (hkObjects *os, guint *r, guint *c)
+/* first and last grid column and row that rect r overlaps */
+{
+  for (int k=4; k--;)
+    c[k] = MIN(r[k] / GRID_CELL, (k & 1 ? os->gh : os->gw) - 1);
+}
+
+static void gridUnlink (hkObjects *os, guint id)
+{
+  guint c = os->cell[id], n = os->next[id], p = os->prev[id];
+  if (c == OBJECTS_NONE) return;
+  if (p == OBJECTS_NONE) os->head[c] = n;
+  else os->next[p] = n;
+  if (n != OBJECTS_NONE) os->prev[n] = p;
+  os->cell[id] = OBJECTS_NONE;
+}
+
+static void objectsGrow (hkObjects *os)
+/* double the ids available */
+{
+  guint cap = MAX(os->cap * 2, 16);
+  os->found = g_realloc (os->found, cap * sizeof os->found[0]);
+  os->vel = g_realloc (os->vel, cap * sizeof os->vel[0]);
+  os->shown = g_realloc (os->shown, cap * sizeof os->shown[0]);
+  os->pred = g_realloc (os->pred, cap * sizeof os->pred[0]);
+  os->win = g_realloc (os->win, cap * sizeof os->win[0]);
+  os->coast = g_renew (guint, os->coast, cap);
+  os->match = g_renew (guint, os->match, cap);
+  os->live = g_renew (guint, os->live, cap);
+  os->place = g_renew (guint, os->place, cap);
+  os->idle = g_renew (guint, os->idle, cap);
+  os->work = g_renew (guint *, os->work, cap);
+  os->next = g_renew (guint, os->next, cap);
+  os->prev = g_renew (guint, os->prev, cap);
+  os->cell = g_renew (guint, os->cell, cap);
+  // all ids in use until now, so the new ones go on in reverse
+  for (guint id=cap; id-- > os->cap;){
+    os->idle[os->nidle++] = id;
+    os->cell[id] = OBJECTS_NONE;
+  }
+  os->cap = cap;
+}
+
+void objectsInit (hkObjects *os, guint width, guint height)
+/* size the grid for a width x height frame, keeping any objects */
+/* call once per caps change */
+{
+  os->gw = MAX((width + GRID_CELL - 1) / GRID_CELL, 1);
+  os->gh = MAX((height + GRID_CELL - 1) / GRID_CELL, 1);
+  os->head = g_renew (guint, os->head, os->gw * os->gh);
+  os->bhead = g_renew (guint, os->bhead, os->gw * os->gh);
+  memset (os->head, 0xff, os->gw * os->gh * sizeof *os->head);
+  for (guint i=0; i<os->nlive; i++){
+    os->cell[os->live[i]] = OBJECTS_NONE;
+    objectMoved (os, os->live[i]);
+  }
+}
+
+guint objectNew (hkObjects *os)
+/* a free id, the last one dropped first; fill in found, then objectMoved */
+{
+  guint id;
+  if (!os->nidle) objectsGrow (os);
+  id = os->idle[--os->nidle];
+  os->place[id] = os->nlive;
+  os->live[os->nlive++] = id;
+  memset (os->found[id], 0, sizeof os->found[0]);
+  os->vel[id][0] = os->vel[id][1] = 0;
+  os->coast[id] = 0;
+  return id;
+}
+
+void objectDrop (hkObjects *os, guint id)
+/* stop tracking id; the last live id takes its place in the list */
+{
+  guint last = os->live[--os->nlive];
+  gridUnlink (os, id);
+  os->live[os->place[id]] = last;
+  os->place[last] = os->place[id];
+  os->found[id][3] = 0;
+  os->idle[os->nidle++] = id;
+}
+
+void objectMoved (hkObjects *os, guint id)
+/* file id under the grid cell of its new center */
+{
+  guint c = gridCell (os, os->found[id][4], os->found[id][5]);
+  if (c == os->cell[id]) return;
+  gridUnlink (os, id);
+  os->cell[id] = c;
+  os->prev[id] = OBJECTS_NONE;
+  os->next[id] = os->head[c];
+  if (os->head[c] != OBJECTS_NONE) os->prev[os->head[c]] = id;
+  os->head[c] = id;
+}
+
+gboolean objectsCover (hkObjects *os, guint *rect, guint margin, guint skip)
+/* whether any object but skip lies inside rect grown by margin */
+{
+  guint r[4], c[4];
+  r[0] = rect[0] > margin ? rect[0] - margin : 0;
+  r[1] = rect[1] > margin ? rect[1] - margin : 0;
+  r[2] = rect[2] + margin, r[3] = rect[3] + margin;
+  // such an object is centered in one of the cells r overlaps
+  gridSpan (os, r, c);
+  for (guint cy=c[1]; cy<=c[3]; cy++)
+    for (guint cx=c[0]; cx<=c[2]; cx++)
+      for (guint o=os->head[cy * os->gw + cx]; o!=OBJECTS_NONE;
+        o=os->next[o]){
+        guint *f = os->found[o];
+        if (o != skip && f[0] >= r[0] && f[1] >= r[1]
+          && f[2] <= r[2] && f[3] <= r[3])
+          return TRUE;
+      }
+  return FALSE;
+}
+
+static gfloat pairCost (guint *pred, guint *rect, guint *win)
+/* 1 - overlap of the expected rect and rect over their union, plus how */
+/* far apart their centers are as a fraction of the window's width+height */
+{
+  gint ix = (gint) MIN(pred[2], rect[2]) + 1 - (gint) MAX(pred[0], rect[0]),
+    iy = (gint) MIN(pred[3], rect[3]) + 1 - (gint) MAX(pred[1], rect[1]);
+  gfloat a = (pred[2] - pred[0] + 1.0f) * (pred[3] - pred[1] + 1),
+    b = (rect[2] - rect[0] + 1.0f) * (rect[3] - rect[1] + 1),
+    both = ix > 0 && iy > 0 ? (gfloat) ix * iy : 0,
+    dx = (rect[0] + rect[2]) / 2 - (gfloat) pred[4],
+    dy = (rect[1] + rect[3]) / 2 - (gfloat) pred[5];
+  return 1 - both / (a + b - both)
+    + sqrtf (dx * dx + dy * dy) / (win[2] - win[0] + win[3] - win[1] + 1);
+}
+
+static int pairOrder (const void *a, const void *b)
+{
+  gfloat ca = ((const hkPair *) a)->cost, cb = ((const hkPair *) b)->cost;
+  return (ca > cb) - (ca < cb);
+}
+
+void objectsAssign (hkObjects *os, hkBlobs *lb, guint size)
+/* pair each live object with at most one blob of lb at least size wide */
+/* and high, centered in its os->win, cheapest pairings first: */
+/* os->match[id] gets a blob, os->owner[blob] an id, else OBJECTS_NONE */
+{
+  guint n = lb->nblobs, np = 0, c[4];
+  if (n > os->maxblobs){
+    os->maxblobs = MAX(n, 2 * os->maxblobs);
+    os->owner = g_renew (guint, os->owner, os->maxblobs);
+    os->bnext = g_renew (guint, os->bnext, os->maxblobs);
+  }
+  // file the blobs under their centers, like the objects
+  memset (os->bhead, 0xff, os->gw * os->gh * sizeof *os->bhead);
+  for (guint b=0; b<n; b++){
+    guint *r = lb->blob[b].rect, cell;
+    os->owner[b] = OBJECTS_NONE;
+    if (r[2]-r[0] < size || r[3]-r[1] < size) continue;
+    cell = gridCell (os, (r[0] + r[2]) / 2, (r[1] + r[3]) / 2);
+    os->bnext[b] = os->bhead[cell];
+    os->bhead[cell] = b;
+  }
+  // each object's candidates, from the cells its window overlaps
+  for (guint i=0; i<os->nlive; i++){
+    guint id = os->live[i], *w = os->win[id];
+    os->match[id] = OBJECTS_NONE;
+    gridSpan (os, w, c);
+    for (guint cy=c[1]; cy<=c[3]; cy++)
+      for (guint cx=c[0]; cx<=c[2]; cx++)
+        for (guint b=os->bhead[cy * os->gw + cx]; b!=OBJECTS_NONE;
+          b=os->bnext[b]){
+          guint *r = lb->blob[b].rect, x = (r[0] + r[2]) / 2,
+            y = (r[1] + r[3]) / 2;
+          if (x < w[0] || x > w[2] || y < w[1] || y > w[3]) continue;
+          if (np == os->maxpairs){
+            os->maxpairs = MAX(64, 2 * os->maxpairs);
+            os->pair = g_renew (hkPair, os->pair, os->maxpairs);
+          }
+          os->pair[np].cost = pairCost (os->pred[id], r, w);
+          os->pair[np].id = id, os->pair[np].blob = b;
+          np++;
+        }
+  }
+  // greedy: the cheapest pairing left whose object and blob are both free
+  qsort (os->pair, np, sizeof *os->pair, pairOrder);
+  for (guint p=0; p<np; p++){
+    hkPair *q = &os->pair[p];
+    if (os->match[q->id] != OBJECTS_NONE
+      || os->owner[q->blob] != OBJECTS_NONE) continue;
+    os->match[q->id] = q->blob;
+    os->owner[q->blob] = q->id;
+  }
+}
+
+void objectsFree (hkObjects *os)
+{
+  g_free (os->found);
+  g_free (os->vel);
+  g_free (os->shown);
+  g_free (os->pred);
+  g_free (os->win);
+  g_free (os->coast);
+  g_free (os->match);
+  g_free (os->live);
+  g_free (os->place);
+  g_free (os->idle);
+  g_free (os->work);
+  g_free (os->head);
+  g_free (os->next);
+  g_free (os->prev);
+  g_free (os->cell);
+  g_free (os->owner);
+  g_free (os->bhead);
+  g_free (os->bnext);
+  g_free (os->pair);
+  memset (os, 0, sizeof *os);
+}
+//}
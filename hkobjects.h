@@ -0,0 +1,66 @@
+/* HKObjects
+ * Copyright (C) 2014 Henry Kroll, www.thenerdshow.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _HKOBJECTS_H_
+#define _HKOBJECTS_H_
+#include "hkblob.h"
+
+#define OBJECTS_NONE G_MAXUINT  /* end of a list, or not in the grid */
+#define GRID_CELL 32            /* grid cell size, luma pixels per side */
+
+typedef struct _hkPair
+{
+  // a possible pairing of an object with a blob, cheapest first
+  gfloat cost;
+  guint id, blob;
+} hkPair;
+
+typedef struct _hkObjects
+{
+  // per object, indexed by object id, grown as needed
+  guint (*found)[9];            /* rect, center, team, area, angle */
+  gfloat (*vel)[2];             /* smoothed motion, pixels per frame */
+  guint (*shown)[9];            /* as marked between analyses */
+  guint (*pred)[6];             /* rect and center expected this frame */
+  guint (*win)[4];              /* where to look for it this frame */
+  guint *coast;                 /* frames since it was last seen */
+  guint *match;                 /* blob paired with it this frame */
+  guint cap;                    /* ids allocated */
+  // ids in use, packed, and each one's place in that list
+  guint *live, *place, nlive;
+  // ids not in use, the last one dropped on top
+  guint *idle, nidle;
+  guint **work;                 /* room for one pointer per id */
+  // uniform grid: each cell lists the objects centered in it
+  guint gw, gh, *head, *next, *prev, *cell;
+  // this frame's blobs: their objects, and the same grid of their centers
+  guint *owner, *bhead, *bnext, maxblobs;
+  hkPair *pair;
+  guint maxpairs;
+} hkObjects;
+
+void objectsInit (hkObjects *os, guint width, guint height);
+guint objectNew (hkObjects *os);
+void objectDrop (hkObjects *os, guint id);
+void objectMoved (hkObjects *os, guint id);
+gboolean objectsCover (hkObjects *os, guint *rect, guint margin, guint skip);
+void objectsAssign (hkObjects *os, hkBlobs *lb, guint size);
+void objectsFree (hkObjects *os);
+
+#endif
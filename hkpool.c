@@ -0,0 +1,107 @@
+/* HKPool
+ * Copyright (C) 2014 Henry Kroll, www.thenerdshow.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+/* Band-parallel frame processing. A frame's rows are cut into one
+ * horizontal band per thread; the calling thread works the first band
+ * while a GThreadPool works the rest, and poolRun returns when all
+ * bands are done.
+ */
+//{
+#include "hkpool.h"
+
+typedef struct _hkBandJob
+{
+  hkPool *p;
+  hkBandFunc fn;
+  gpointer data;
+  guint band, y0, y1;
+} hkBandJob;
+
+static void poolWork (gpointer job_, gpointer p_)
+{
+  hkBandJob *job = job_;
+  hkPool *p = p_;
+  job->fn (job->data, job->band, job->y0, job->y1);
+  g_mutex_lock (&p->lock);
+  if (!--p->pending) g_cond_signal (&p->done);
+  g_mutex_unlock (&p->lock);
+}
+
+void poolInit (hkPool *p)
+{
+  p->pool = NULL;
+  p->threads = p->requested = 1;
+  p->pending = 0;
+  g_mutex_init (&p->lock);
+  g_cond_init (&p->done);
+}
+
+void poolThreads (hkPool *p, guint threads)
+/* use threads bands per frame, 0 for one per CPU */
+/* call between frames only */
+{
+  if (threads == p->requested) return;
+  p->requested = threads;
+  if (!threads) threads = g_get_num_processors ();
+  p->threads = MAX(threads, 1);
+  if (p->threads == 1) return;
+  if (!p->pool)
+    p->pool = g_thread_pool_new (poolWork, p, p->threads - 1, FALSE, NULL);
+  else
+    g_thread_pool_set_max_threads (p->pool, p->threads - 1, NULL);
+}
+
+guint poolBands (hkPool *p, guint y0, guint y1)
+/* how many bands poolRun will cut rows y0..y1 into */
+{
+  return y1 < y0 ? 0 : MIN(p->threads, y1 - y0 + 1);
+}
+
+void poolRun (hkPool *p, hkBandFunc fn, gpointer data, guint y0, guint y1)
+/* call fn once per band of rows y0..y1, in parallel; wait for all */
+{
+  guint n = poolBands (p, y0, y1), rows = y1 - y0 + 1;
+  hkBandJob *job;
+  if (!n) return;
+  if (n == 1 || !p->pool){
+    fn (data, 0, y0, y1);
+    return;
+  }
+  job = g_newa (hkBandJob, n);
+  for (guint b=0; b<n; b++){
+    job[b].p = p, job[b].fn = fn, job[b].data = data, job[b].band = b;
+    job[b].y0 = y0 + (guint64) rows * b / n;
+    job[b].y1 = y0 + (guint64) rows * (b + 1) / n - 1;
+  }
+  p->pending = n - 1;
+  for (guint b=1; b<n; b++)
+    g_thread_pool_push (p->pool, &job[b], NULL);
+  fn (data, 0, job[0].y0, job[0].y1);
+  g_mutex_lock (&p->lock);
+  while (p->pending) g_cond_wait (&p->done, &p->lock);
+  g_mutex_unlock (&p->lock);
+}
+
+void poolFree (hkPool *p)
+{
+  if (p->pool) g_thread_pool_free (p->pool, FALSE, TRUE);
+  p->pool = NULL;
+  g_mutex_clear (&p->lock);
+  g_cond_clear (&p->done);
+}
+//}
@@ -0,0 +1,43 @@
+/* HKPool
+ * Copyright (C) 2014 Henry Kroll, www.thenerdshow.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _HKPOOL_H_
+#define _HKPOOL_H_
+#include <glib.h>
+
+// work on rows y0..y1 of a frame, as band number band
+typedef void (*hkBandFunc) (gpointer data, guint band, guint y0, guint y1);
+
+typedef struct _hkPool
+{
+  GThreadPool *pool;            /* helpers; NULL with one thread */
+  guint threads;                /* bands per frame, caller included */
+  guint requested;              /* 0 = one per CPU */
+  GMutex lock;
+  GCond done;
+  guint pending;                /* bands not yet finished */
+} hkPool;
+
+void poolInit (hkPool *p);
+void poolThreads (hkPool *p, guint threads);
+guint poolBands (hkPool *p, guint y0, guint y1);
+void poolRun (hkPool *p, hkBandFunc fn, gpointer data, guint y0, guint y1);
+void poolFree (hkPool *p);
+
+#endif
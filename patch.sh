@@ -1,5 +1,5 @@
 #!/bin/bash
 
-cp -l * $HOME/rpmbuild/BUILD/gst-plugins-bad-0.10.*/gst/hkfilters
+cp -l * $HOME/rpmbuild/BUILD/gst-plugins-bad-1.*/gst/hkfilters
 
-patch -p0 $HOME/rpmbuild/BUILD/gst-plugins-bad-0.10.*/configure.ac < configure.ac.patch
\ No newline at end of file
+patch -p0 $HOME/rpmbuild/BUILD/gst-plugins-bad-1.*/configure.ac < configure.ac.patch
\ No newline at end of file
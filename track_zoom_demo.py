@@ -23,39 +23,40 @@
 
 import sys
 
-import pygst
-pygst.require('0.10')
+import gi
+gi.require_version('Gst', '1.0')
 
-import gst
+from gi.repository import Gst
 
 class test():
 
    def track_cb(self, sender, *args):
       msg = args[0]
-      if msg.type == gst.MESSAGE_ELEMENT\
-         and msg.structure.get_name()=="track":
-         if msg.structure["object"] == 0:
+      s = msg.get_structure()
+      if msg.type == Gst.MessageType.ELEMENT\
+         and s.get_name()=="track":
+         if s["object"] == 0:
             mix = self.bin.get_by_name("mix")
-            pads = list(mix.pads())
-            pad = pads[0]
-            xc = msg.structure["xc"]
-            yc = msg.structure["yc"]
+            pad = mix.sinkpads[0]
+            xc = s["xc"]
+            yc = s["yc"]
             x = (320 - xc)
             y = (180 - yc)
             pad.set_property("xpos",x)
             pad.set_property("ypos",y)
-      return gst.BUS_PASS
+      return Gst.BusSyncReply.PASS
 
    def __init__(self, args):
 
-      self.bin = gst.parse_launch("filesrc location=paper.avi\
+      Gst.init(None)
+      self.bin = Gst.parse_launch("filesrc location=paper.avi\
  ! queue\
  ! decodebin\
  ! tee name=tee\
  ! videoscale\
- ! video/x-raw-yuv,width=240,height=200\
- ! cairotextoverlay text=\"unstable camera?\"\
- ! videomixer2 name=mix2\
+ ! video/x-raw,width=240,height=200\
+ ! textoverlay text=\"unstable camera?\"\
+ ! videomixer name=mix2\
  sink_0::ypos=200\
  ! videocrop top=50\
  ! autovideoconvert\
@@ -63,22 +64,23 @@ class test():
  tee.\
  ! queue\
  ! track replace=0 objects=1 bgcolor=0x7CA0D5 size=8 threshold=88 name=trk\
- ! videomixer2 name=mix\
+ ! videomixer name=mix\
  ! videocrop left=200 right=200 top=120 bottom=100\
- ! cairotextoverlay text=\"zoom to objects\"\
+ ! textoverlay text=\"zoom to objects\"\
  ! mix2.")
       bus = self.bin.get_bus()
       bus.add_signal_watch()
       bus.connect("message::element", self.track_cb)
-      res = self.bin.set_state(gst.STATE_PLAYING);
+      res = self.bin.set_state(Gst.State.PLAYING);
       assert res
 
       while 1:
-         msg = bus.poll(gst.MESSAGE_EOS | gst.MESSAGE_ERROR, gst.SECOND)
+         msg = bus.poll(Gst.MessageType.EOS | Gst.MessageType.ERROR,
+            Gst.SECOND)
          if msg:
              break
 
-      res = self.bin.set_state(gst.STATE_NULL)
+      res = self.bin.set_state(Gst.State.NULL)
       assert res
 
 if __name__ == '__main__':